@@ -0,0 +1,323 @@
+#include "benchmark.h"
+#include "physics/forcefieldgrid.h"
+#include "physics/forcefieldkernels.h"
+#include "physics/verletsolver.h"
+#include "core/rectworld.h"
+#include "simulation/components.h"
+#include "ecs/world.h"
+#include "structs/vector2.h"
+#include "utils/math.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include <functional>
+
+static constexpr float worldSize = 1080.0f;
+static constexpr float cellSize = 25.0f;
+static constexpr size_t particleCount = 16384;
+static constexpr uint32_t passes = 50;
+static constexpr size_t blockSize = 16;
+
+struct Particles
+{
+	std::vector<float> x = {};
+	std::vector<float> y = {};
+	std::vector<float> invMass = {};
+};
+
+//Evaluation of a single field for a single particle, branching on the settings, as the solver did it before the kernels
+static Vector2 CalcForceField(const ForceField& field, float invMass, Vector2 pos)
+{
+	const ForceFieldSettings& s = field.settings;
+	const Vector2 toPos = pos - field.pos;
+	const float eps = 1e-5f;
+
+	Vector2 local = toPos;
+	Vector2 halfRectSize = s.rectSize * 0.5f;
+	if(s.shape == ForceFieldShape::Circle)
+	{
+		float r2 = s.range * s.range;
+		if(toPos.SqrLength() > r2)
+		{
+			return Vector2::zero;
+		}
+	}
+	else
+	{
+		local = Vector2::Rotate(toPos, -s.rectRotation);
+		if(std::fabs(local.x) > halfRectSize.x || std::fabs(local.y) > halfRectSize.y)
+		{
+			return Vector2::zero;
+		}
+	}
+
+	Vector2 dir;
+	if(s.direction == ForceFieldDirection::FromCenter)
+	{
+		float len = toPos.SqrLength();
+		if(len < eps)
+		{
+			return Vector2::zero;
+		}
+		dir = toPos / std::sqrtf(len);
+	}
+	else
+	{
+		dir = s.DirVector();
+		if(s.shape == ForceFieldShape::Rect)
+		{
+			dir = Vector2::Rotate(dir, s.rectRotation);
+		}
+	}
+
+	float falloff = 1.0f;
+	if(s.falloff != ForceFieldFalloff::None)
+	{
+		if(s.shape == ForceFieldShape::Circle)
+		{
+			falloff = 1.0f - toPos.Length() / std::max(s.range, eps);
+		}
+		else
+		{
+			const float mx = 1.0f - std::fabs(local.x) / std::max(halfRectSize.x, eps);
+			const float my = 1.0f - std::fabs(local.y) / std::max(halfRectSize.y, eps);
+			falloff = std::fminf(mx, my);
+		}
+		falloff = s.ApplyFalloff(std::clamp(falloff, 0.0f, 1.0f));
+	}
+
+	float mag = s.massDependent ? (s.force * falloff * invMass) : (s.force * falloff);
+	return dir * mag;
+}
+
+static std::vector<ForceField> RandomFields(size_t count, float minRange, float maxRange, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> unit = std::uniform_real_distribution<float>(0.0f, 1.0f);
+	std::vector<ForceField> fields = {};
+	for(size_t i = 0; i < count; i++)
+	{
+		ForceFieldSettings s = {};
+		s.force = 50.0f + unit(rng) * 500.0f;
+		s.massDependent = unit(rng) < 0.5f;
+		s.falloff = static_cast<ForceFieldFalloff>(rng() % 6);
+		s.shape = unit(rng) < 0.5f ? ForceFieldShape::Circle : ForceFieldShape::Rect;
+		s.range = minRange + unit(rng) * (maxRange - minRange);
+		s.rectSize = Vector2(s.range * (1.0f + unit(rng)), s.range * (1.0f + unit(rng)));
+		s.rectRotation = unit(rng) * 360.0f;
+		s.direction = static_cast<ForceFieldDirection>(rng() % 6);
+		s.customDirection = unit(rng) * 360.0f;
+		fields.emplace_back(s, Vector2(unit(rng), unit(rng)) * worldSize);
+	}
+	return fields;
+}
+
+static Particles RandomParticles(bool zOrder, std::mt19937& rng)
+{
+	std::uniform_real_distribution<float> unit = std::uniform_real_distribution<float>(0.0f, 1.0f);
+	std::vector<Vector2> positions = std::vector<Vector2>(particleCount);
+	for(Vector2& pos : positions)
+	{
+		pos = Vector2(unit(rng), unit(rng)) * worldSize;
+	}
+
+	//Same order the solver reorders its storage into
+	if(zOrder)
+	{
+		auto key = [](Vector2 pos)
+		{
+			return Math::Morton2D(static_cast<uint32_t>(pos.x / cellSize), static_cast<uint32_t>(pos.y / cellSize));
+		};
+		std::stable_sort(positions.begin(), positions.end(), [&](Vector2 a, Vector2 b) { return key(a) < key(b); });
+	}
+
+	Particles particles = {};
+	for(Vector2 pos : positions)
+	{
+		particles.x.push_back(pos.x);
+		particles.y.push_back(pos.y);
+		particles.invMass.push_back(0.5f + unit(rng) * 1.5f);
+	}
+	return particles;
+}
+
+//Milliseconds per pass over all particles
+static double Time(const std::function<void()>& pass)
+{
+	pass();
+	const auto start = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < passes; i++)
+	{
+		pass();
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / passes;
+}
+
+int Benchmark::Run(int argc, char** argv)
+{
+	const std::string name = argc > 0 ? argv[0] : "";
+	if(name == "forcefields")
+	{
+		return ForceFields();
+	}
+	if(name == "sweep")
+	{
+		return Sweep();
+	}
+
+	std::cerr << "Usage: --benchmark forcefields|sweep" << std::endl;
+	return 1;
+}
+
+int Benchmark::ForceFields()
+{
+	struct FieldSet
+	{
+		const char* name;
+		size_t count;
+		float minRange;
+		float maxRange;
+	};
+	const std::vector<FieldSet> sets = { { "1 large", 1, 300.0f, 400.0f }, { "32 large", 32, 100.0f, 250.0f }, { "48 small", 48, 15.0f, 40.0f } };
+	const int32_t cells = static_cast<int32_t>(worldSize / cellSize);
+
+	std::cout << std::fixed << std::setprecision(3);
+	std::cout << particleCount << " particles, ms per pass: branching per cell | kernels, block bounds | kernels per cell, max relative error, ms to build the cell lists" << std::endl;
+	bool valid = true;
+	for(const FieldSet& set : sets)
+	{
+		for(bool zOrder : { true, false })
+		{
+			std::mt19937 rng = std::mt19937(1234);
+			const std::vector<ForceField> fields = RandomFields(set.count, set.minRange, set.maxRange, rng);
+			const Particles p = RandomParticles(zOrder, rng);
+
+			std::vector<ForceFieldKernels::PreparedField> prepared = {};
+			for(const ForceField& field : fields)
+			{
+				prepared.push_back(ForceFieldKernels::Prepare(field));
+			}
+			std::vector<ForceFieldKernels::PreparedField> sorted = prepared;
+			std::stable_sort(sorted.begin(), sorted.end(), [](const ForceFieldKernels::PreparedField& a, const ForceFieldKernels::PreparedField& b)
+			{
+				return a.config < b.config;
+			});
+
+			//The solver only builds the lists when the fields change, so the build is timed on its own and not part of a pass
+			ForceFieldGrid grid = {};
+			const double setup = Time([&]
+			{
+				grid.Build(std::vector<ForceFieldKernels::PreparedField>(prepared), Vector2::zero, Vector2(worldSize, worldSize), cells, cells);
+			});
+
+			//Per cell lists of the fields for the branching path
+			std::vector<std::vector<uint32_t>> cellFields = std::vector<std::vector<uint32_t>>(static_cast<size_t>(cells) * cells);
+			auto cellCoord = [&](float v) { return std::clamp(static_cast<int32_t>(v / cellSize), 0, cells - 1); };
+			for(uint32_t f = 0; f < fields.size(); f++)
+			{
+				const Vector2 extents = fields[f].settings.Extents();
+				for(int32_t x = cellCoord(fields[f].pos.x - extents.x); x <= cellCoord(fields[f].pos.x + extents.x); x++)
+				{
+					for(int32_t y = cellCoord(fields[f].pos.y - extents.y); y <= cellCoord(fields[f].pos.y + extents.y); y++)
+					{
+						cellFields[x * cells + y].push_back(f);
+					}
+				}
+			}
+
+			std::vector<float> refX = std::vector<float>(particleCount);
+			std::vector<float> refY = std::vector<float>(particleCount);
+			const double branching = Time([&]
+			{
+				for(size_t i = 0; i < particleCount; i++)
+				{
+					const Vector2 pos = Vector2(p.x[i], p.y[i]);
+					Vector2 acc = Vector2::zero;
+					for(uint32_t f : cellFields[cellCoord(pos.x) * cells + cellCoord(pos.y)])
+					{
+						acc += CalcForceField(fields[f], p.invMass[i], pos);
+					}
+					refX[i] = acc.x;
+					refY[i] = acc.y;
+				}
+			});
+
+			std::vector<float> accX = std::vector<float>(particleCount);
+			std::vector<float> accY = std::vector<float>(particleCount);
+			const double blockBounds = Time([&]
+			{
+				std::fill(accX.begin(), accX.end(), 0.0f);
+				std::fill(accY.begin(), accY.end(), 0.0f);
+				for(size_t block = 0; block < particleCount; block += blockSize)
+				{
+					const auto [minX, maxX] = std::minmax_element(p.x.data() + block, p.x.data() + block + blockSize);
+					const auto [minY, maxY] = std::minmax_element(p.y.data() + block, p.y.data() + block + blockSize);
+					for(const ForceFieldKernels::PreparedField& field : sorted)
+					{
+						if(field.max.x < *minX || field.min.x > *maxX || field.max.y < *minY || field.min.y > *maxY)
+						{
+							continue;
+						}
+						field.kernel(field, p.x.data() + block, p.y.data() + block, p.invMass.data() + block, blockSize, accX.data() + block, accY.data() + block);
+					}
+				}
+			});
+
+			const double perCell = Time([&]
+			{
+				std::fill(accX.begin(), accX.end(), 0.0f);
+				std::fill(accY.begin(), accY.end(), 0.0f);
+				grid.Accumulate(p.x.data(), p.y.data(), p.invMass.data(), particleCount, accX.data(), accY.data());
+			});
+
+			double maxError = 0.0;
+			for(size_t i = 0; i < particleCount; i++)
+			{
+				const Vector2 ref = Vector2(refX[i], refY[i]);
+				const double error = (Vector2(accX[i], accY[i]) - ref).Length() / std::max(ref.Length(), 1.0f);
+				maxError = std::max(maxError, error);
+			}
+			valid &= maxError < 1e-3;
+
+			std::cout << std::setw(9) << set.name << (zOrder ? ", z-order: " : ", random:  ") << branching << " | " << blockBounds << " | " << perCell
+				<< ", " << std::scientific << std::setprecision(1) << maxError << std::fixed << std::setprecision(3) << ", " << setup << std::endl;
+		}
+	}
+	return valid ? 0 : 1;
+}
+
+int Benchmark::Sweep()
+{
+	constexpr float radius = 2.0f;
+	constexpr uint32_t frames = 10;
+	const Vector2 velocity = Vector2(radius * 6.0f, radius * 3.0f);
+	const Vector2 start = Vector2(worldSize * 0.25f, worldSize * 0.25f);
+
+	SolverSettings settings = {};
+	settings.updateMode = SolverUpdateMode::FrameFixedStep;
+	settings.substeps = 1;
+	settings.gravity = Vector2::zero;
+	settings.continuousCollision = true;
+	RectWorld world = RectWorld(Color(), Vector2(worldSize, worldSize) * 0.5f, Vector2(worldSize, worldSize), Color());
+	EcsWorld ecs = EcsWorld();
+	ecs.CreateEntity(Transform(Matrix4::PositionScale2d(start, radius * 2.0f)), Particle(radius, 1.0f, 0.0f, false, start - velocity, Vector2::zero));
+	VerletSolver solver = VerletSolver(ecs, world, settings);
+	for(uint32_t frame = 0; frame < frames; frame++)
+	{
+		solver.Update(settings.timestep);
+	}
+
+	Vector2 pos = Vector2::zero;
+	ecs.QueryChunked<Transform, Particle>(std::numeric_limits<size_t>::max(), [&](Transform* t, Particle* _, size_t count)
+	{
+		pos = t[0].Position();
+	});
+	const Vector2 expected = start + velocity * static_cast<float>(frames);
+	const float error = (pos - expected).Length();
+	std::cout << std::fixed << std::setprecision(3) << "Moved to (" << pos.x << ", " << pos.y << "), expected (" << expected.x << ", " << expected.y << ")" << std::endl;
+	return error < 1e-2f ? 0 : 1;
+}
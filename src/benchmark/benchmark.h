@@ -0,0 +1,16 @@
+#pragma once
+
+//Headless measurements of the solver, started with --benchmark <name> [arguments] instead of opening the window
+namespace Benchmark
+{
+	//Arguments start after --benchmark, returns the exit code of the process
+	int Run(int argc, char** argv);
+
+	//Times the force field kernels over per cell field lists against the branching per particle evaluation they replaced,
+	//for a few field sets with particles in z-order and in random order, and checks that both agree
+	//Building the cell lists is timed separately, the solver only does it when the fields change
+	int ForceFields();
+
+	//Checks that continuous collision leaves a lone particle moving further than its diameter per substep at its velocity
+	int Sweep();
+}
@@ -1,6 +1,10 @@
 #include "circleworld.h"
 #include "renderer/graphics.h"
 #include "imgui.h"
+#include <cmath>
+#if CPU_X64
+#include <immintrin.h>
+#endif
 
 CircleWorld::CircleWorld(Color background, Vector2 center, float radius, Color color) : World(background), center(center), radius(radius), color(color)
 {
@@ -23,11 +27,11 @@ bool CircleWorld::Contains(Vector2 point) const
 	return Vector2::Distance(center, point) <= radius;
 }
 
-void CircleWorld::Contrain(Vector2& pos, Particle& p) const
+void CircleWorld::Contrain(Vector2& pos, Vector2& prevPos, float radius, float bounciness) const
 {
 	Vector2 dir = pos - center;
 	float dst = dir.SqrLength();
-	float rad = radius - p.radius;
+	float rad = this->radius - radius;
 	if(dst > rad * rad)
 	{
 		Vector2 normDir = dir / std::sqrtf(dst);
@@ -35,6 +39,106 @@ void CircleWorld::Contrain(Vector2& pos, Particle& p) const
 	}
 }
 
+ConstraintKernel CircleWorld::BatchKernel(SimdLevel level) const
+{
+	switch(level)
+	{
+		case SimdLevel::AVX2:
+			return &ConstrainBatch<SimdLevel::AVX2>;
+		case SimdLevel::SSE:
+			return &ConstrainBatch<SimdLevel::SSE>;
+		default:
+			return &ConstrainBatch<SimdLevel::Scalar>;
+	}
+}
+
+#if CPU_X64
+//The lanes go through the same operations as Contrain, so every instruction set gives the same results
+static size_t ConstrainSSE(Vector2 center, float worldRadius, const ConstraintBatch& b)
+{
+	const __m128 cx = _mm_set1_ps(center.x);
+	const __m128 cy = _mm_set1_ps(center.y);
+	const __m128 r = _mm_set1_ps(worldRadius);
+	size_t i = 0;
+	for(; i + 4 <= b.count; i += 4)
+	{
+		const __m128 x = _mm_loadu_ps(&b.posX[i]);
+		const __m128 y = _mm_loadu_ps(&b.posY[i]);
+		const __m128 dx = _mm_sub_ps(x, cx);
+		const __m128 dy = _mm_sub_ps(y, cy);
+		const __m128 dst = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		const __m128 rad = _mm_sub_ps(r, _mm_loadu_ps(&b.radius[i]));
+		const __m128 outside = _mm_cmpgt_ps(dst, _mm_mul_ps(rad, rad));
+		if(_mm_movemask_ps(outside) == 0)
+		{
+			continue;
+		}
+
+		const __m128 len = _mm_sqrt_ps(dst);
+		const __m128 newX = _mm_add_ps(cx, _mm_mul_ps(_mm_div_ps(dx, len), rad));
+		const __m128 newY = _mm_add_ps(cy, _mm_mul_ps(_mm_div_ps(dy, len), rad));
+		_mm_storeu_ps(&b.posX[i], _mm_or_ps(_mm_and_ps(outside, newX), _mm_andnot_ps(outside, x)));
+		_mm_storeu_ps(&b.posY[i], _mm_or_ps(_mm_and_ps(outside, newY), _mm_andnot_ps(outside, y)));
+	}
+	return i;
+}
+
+CPU_TARGET_AVX2 static size_t ConstrainAVX2(Vector2 center, float worldRadius, const ConstraintBatch& b)
+{
+	const __m256 cx = _mm256_set1_ps(center.x);
+	const __m256 cy = _mm256_set1_ps(center.y);
+	const __m256 r = _mm256_set1_ps(worldRadius);
+	size_t i = 0;
+	for(; i + 8 <= b.count; i += 8)
+	{
+		const __m256 x = _mm256_loadu_ps(&b.posX[i]);
+		const __m256 y = _mm256_loadu_ps(&b.posY[i]);
+		const __m256 dx = _mm256_sub_ps(x, cx);
+		const __m256 dy = _mm256_sub_ps(y, cy);
+		const __m256 dst = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+		const __m256 rad = _mm256_sub_ps(r, _mm256_loadu_ps(&b.radius[i]));
+		const __m256 outside = _mm256_cmp_ps(dst, _mm256_mul_ps(rad, rad), _CMP_GT_OQ);
+		if(_mm256_movemask_ps(outside) == 0)
+		{
+			continue;
+		}
+
+		const __m256 len = _mm256_sqrt_ps(dst);
+		const __m256 newX = _mm256_add_ps(cx, _mm256_mul_ps(_mm256_div_ps(dx, len), rad));
+		const __m256 newY = _mm256_add_ps(cy, _mm256_mul_ps(_mm256_div_ps(dy, len), rad));
+		_mm256_storeu_ps(&b.posX[i], _mm256_blendv_ps(x, newX, outside));
+		_mm256_storeu_ps(&b.posY[i], _mm256_blendv_ps(y, newY, outside));
+	}
+	return i;
+}
+#endif
+
+template<SimdLevel L>
+void CircleWorld::ConstrainBatch(const IConstraint& constraint, const ConstraintBatch& b)
+{
+	const CircleWorld& world = static_cast<const CircleWorld&>(constraint);
+	size_t i = 0;
+#if CPU_X64
+	if constexpr(L == SimdLevel::AVX2)
+	{
+		i = ConstrainAVX2(world.center, world.radius, b);
+	}
+	else if constexpr(L == SimdLevel::SSE)
+	{
+		i = ConstrainSSE(world.center, world.radius, b);
+	}
+#endif
+	//Remaining particles which don't fill all lanes
+	for(; i < b.count; i++)
+	{
+		Vector2 pos = Vector2(b.posX[i], b.posY[i]);
+		Vector2 prevPos = Vector2(b.prevX[i], b.prevY[i]);
+		world.Contrain(pos, prevPos, b.radius[i], b.bounciness[i]);
+		b.posX[i] = pos.x;
+		b.posY[i] = pos.y;
+	}
+}
+
 std::pair<Vector2, Vector2> CircleWorld::Bounds() const
 {
 	Vector2 size = Vector2(radius, radius);
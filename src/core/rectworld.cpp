@@ -2,6 +2,9 @@
 #include "renderer/graphics.h"
 #include "utils/math.h"
 #include <cmath>
+#if CPU_X64
+#include <immintrin.h>
+#endif
 
 RectWorld::RectWorld(Color background, Vector2 center, Vector2 size, Color color) : World(background), center(center), extends(size * 0.5f), color(color)
 {
@@ -26,26 +29,161 @@ bool RectWorld::Contains(Vector2 point) const
 	return min.x < point.x && max.x > point.x && min.y < point.y && max.y > point.y;
 }
 
-void RectWorld::Contrain(Vector2& pos, Particle& p) const
+void RectWorld::Contrain(Vector2& pos, Vector2& prevPos, float radius, float bounciness) const
 {
 	float xDiff = pos.x - center.x;
-	float extX = extends.x - p.radius;
+	float extX = extends.x - radius;
 	if(std::fabsf(xDiff) > extX)
 	{
-		Vector2 vel = pos - p.prevPos;
+		Vector2 vel = pos - prevPos;
 		float sgn = Math::Sgn(xDiff);
 		pos.x = center.x + sgn * extX;
-		p.prevPos = pos + Vector2(vel.x * p.bounciness, -vel.y);
+		prevPos = pos + Vector2(vel.x * bounciness, -vel.y);
 	}
 
 	float yDiff = pos.y - center.y;
-	float extY = extends.y - p.radius;
+	float extY = extends.y - radius;
 	if(std::fabsf(yDiff) > extY)
 	{
-		Vector2 vel = pos - p.prevPos;
+		Vector2 vel = pos - prevPos;
 		float sgn = Math::Sgn(yDiff);
 		pos.y = center.y + sgn * extY;
-		p.prevPos = pos + Vector2(-vel.x, vel.y * p.bounciness);
+		prevPos = pos + Vector2(-vel.x, vel.y * bounciness);
+	}
+}
+
+ConstraintKernel RectWorld::BatchKernel(SimdLevel level) const
+{
+	switch(level)
+	{
+		case SimdLevel::AVX2:
+			return &ConstrainBatch<SimdLevel::AVX2>;
+		case SimdLevel::SSE:
+			return &ConstrainBatch<SimdLevel::SSE>;
+		default:
+			return &ConstrainBatch<SimdLevel::Scalar>;
+	}
+}
+
+#if CPU_X64
+//The lanes go through the same operations as Contrain, so every instruction set gives the same results
+//Pushes one axis back inside, a is the axis being tested and o the other one
+static void ConstrainAxisSSE(__m128 center, __m128 extends, __m128 radius, __m128 bounciness, __m128& a, __m128& prevA, __m128 o, __m128& prevO)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 diff = _mm_sub_ps(a, center);
+	const __m128 ext = _mm_sub_ps(extends, radius);
+	const __m128 outside = _mm_cmpgt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), diff), ext);
+
+	const __m128 velA = _mm_sub_ps(a, prevA);
+	const __m128 velO = _mm_sub_ps(o, prevO);
+	const __m128 sgn = _mm_sub_ps(_mm_and_ps(_mm_cmplt_ps(zero, diff), one), _mm_and_ps(_mm_cmplt_ps(diff, zero), one));
+	const __m128 newA = _mm_add_ps(center, _mm_mul_ps(sgn, ext));
+	const __m128 newPrevA = _mm_add_ps(newA, _mm_mul_ps(velA, bounciness));
+	const __m128 newPrevO = _mm_sub_ps(o, velO);
+
+	a = _mm_or_ps(_mm_and_ps(outside, newA), _mm_andnot_ps(outside, a));
+	prevA = _mm_or_ps(_mm_and_ps(outside, newPrevA), _mm_andnot_ps(outside, prevA));
+	prevO = _mm_or_ps(_mm_and_ps(outside, newPrevO), _mm_andnot_ps(outside, prevO));
+}
+
+static size_t ConstrainSSE(Vector2 center, Vector2 extends, const ConstraintBatch& b)
+{
+	const __m128 cx = _mm_set1_ps(center.x);
+	const __m128 cy = _mm_set1_ps(center.y);
+	const __m128 ex = _mm_set1_ps(extends.x);
+	const __m128 ey = _mm_set1_ps(extends.y);
+	size_t i = 0;
+	for(; i + 4 <= b.count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&b.posX[i]);
+		__m128 y = _mm_loadu_ps(&b.posY[i]);
+		__m128 prevX = _mm_loadu_ps(&b.prevX[i]);
+		__m128 prevY = _mm_loadu_ps(&b.prevY[i]);
+		const __m128 radius = _mm_loadu_ps(&b.radius[i]);
+		const __m128 bounciness = _mm_loadu_ps(&b.bounciness[i]);
+		ConstrainAxisSSE(cx, ex, radius, bounciness, x, prevX, y, prevY);
+		ConstrainAxisSSE(cy, ey, radius, bounciness, y, prevY, x, prevX);
+		_mm_storeu_ps(&b.posX[i], x);
+		_mm_storeu_ps(&b.posY[i], y);
+		_mm_storeu_ps(&b.prevX[i], prevX);
+		_mm_storeu_ps(&b.prevY[i], prevY);
+	}
+	return i;
+}
+
+CPU_TARGET_AVX2 static void ConstrainAxisAVX2(__m256 center, __m256 extends, __m256 radius, __m256 bounciness, __m256& a, __m256& prevA, __m256 o, __m256& prevO)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 diff = _mm256_sub_ps(a, center);
+	const __m256 ext = _mm256_sub_ps(extends, radius);
+	const __m256 outside = _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), diff), ext, _CMP_GT_OQ);
+
+	const __m256 velA = _mm256_sub_ps(a, prevA);
+	const __m256 velO = _mm256_sub_ps(o, prevO);
+	const __m256 sgn = _mm256_sub_ps(_mm256_and_ps(_mm256_cmp_ps(zero, diff, _CMP_LT_OQ), one), _mm256_and_ps(_mm256_cmp_ps(diff, zero, _CMP_LT_OQ), one));
+	const __m256 newA = _mm256_add_ps(center, _mm256_mul_ps(sgn, ext));
+	const __m256 newPrevA = _mm256_add_ps(newA, _mm256_mul_ps(velA, bounciness));
+	const __m256 newPrevO = _mm256_sub_ps(o, velO);
+
+	a = _mm256_blendv_ps(a, newA, outside);
+	prevA = _mm256_blendv_ps(prevA, newPrevA, outside);
+	prevO = _mm256_blendv_ps(prevO, newPrevO, outside);
+}
+
+CPU_TARGET_AVX2 static size_t ConstrainAVX2(Vector2 center, Vector2 extends, const ConstraintBatch& b)
+{
+	const __m256 cx = _mm256_set1_ps(center.x);
+	const __m256 cy = _mm256_set1_ps(center.y);
+	const __m256 ex = _mm256_set1_ps(extends.x);
+	const __m256 ey = _mm256_set1_ps(extends.y);
+	size_t i = 0;
+	for(; i + 8 <= b.count; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(&b.posX[i]);
+		__m256 y = _mm256_loadu_ps(&b.posY[i]);
+		__m256 prevX = _mm256_loadu_ps(&b.prevX[i]);
+		__m256 prevY = _mm256_loadu_ps(&b.prevY[i]);
+		const __m256 radius = _mm256_loadu_ps(&b.radius[i]);
+		const __m256 bounciness = _mm256_loadu_ps(&b.bounciness[i]);
+		ConstrainAxisAVX2(cx, ex, radius, bounciness, x, prevX, y, prevY);
+		ConstrainAxisAVX2(cy, ey, radius, bounciness, y, prevY, x, prevX);
+		_mm256_storeu_ps(&b.posX[i], x);
+		_mm256_storeu_ps(&b.posY[i], y);
+		_mm256_storeu_ps(&b.prevX[i], prevX);
+		_mm256_storeu_ps(&b.prevY[i], prevY);
+	}
+	return i;
+}
+#endif
+
+template<SimdLevel L>
+void RectWorld::ConstrainBatch(const IConstraint& constraint, const ConstraintBatch& b)
+{
+	const RectWorld& world = static_cast<const RectWorld&>(constraint);
+	size_t i = 0;
+#if CPU_X64
+	if constexpr(L == SimdLevel::AVX2)
+	{
+		i = ConstrainAVX2(world.center, world.extends, b);
+	}
+	else if constexpr(L == SimdLevel::SSE)
+	{
+		i = ConstrainSSE(world.center, world.extends, b);
+	}
+#endif
+	//Remaining particles which don't fill all lanes
+	for(; i < b.count; i++)
+	{
+		Vector2 pos = Vector2(b.posX[i], b.posY[i]);
+		Vector2 prevPos = Vector2(b.prevX[i], b.prevY[i]);
+		world.Contrain(pos, prevPos, b.radius[i], b.bounciness[i]);
+		b.posX[i] = pos.x;
+		b.posY[i] = pos.y;
+		b.prevX[i] = prevPos.x;
+		b.prevY[i] = prevPos.y;
 	}
 }
 
@@ -11,10 +11,14 @@ public:
 	void Render() override;
 	Vector2 Center() const override;
 	bool Contains(Vector2 point) const override;
-	void Contrain(Vector2& pos, Particle& p) const override;
+	void Contrain(Vector2& pos, Vector2& prevPos, float radius, float bounciness) const;
+	ConstraintKernel BatchKernel(SimdLevel level) const override;
 	std::pair<Vector2, Vector2> Bounds() const override;
 
 private:
+	template<SimdLevel L>
+	static void ConstrainBatch(const IConstraint& constraint, const ConstraintBatch& batch);
+
 	Vector2 center;
 	Vector2 extends;
 	Color color;
@@ -4,6 +4,7 @@
 #include <vector>
 #include <array>
 #include <utility>
+#include <algorithm>
 #include <cassert>
 
 using ArchetypeId = std::vector<ComponentId>;
@@ -32,6 +33,7 @@ public:
 			const uint8_t* begin = reinterpret_cast<const uint8_t*>(std::get<2>(comps[i]));
 			compData.data.insert(compData.data.end(), begin, begin + compData.elementSize);
 		}
+		entities.push_back(entity);
 		return size++;
 	}
 
@@ -61,8 +63,36 @@ public:
 		}
 	}
 
+	const Entity* Entities() const
+	{
+		return entities.data();
+	}
+
+	//Moves the entity at order[i] to index i
+	void Reorder(const std::vector<uint32_t>& order)
+	{
+		assert(order.size() == size);
+		for(ComponentData& compData : components)
+		{
+			std::vector<uint8_t> reordered = std::vector<uint8_t>(compData.data.size());
+			for(size_t i = 0; i < size; i++)
+			{
+				std::copy_n(&compData.data[order[i] * compData.elementSize], compData.elementSize, &reordered[i * compData.elementSize]);
+			}
+			compData.data = std::move(reordered);
+		}
+
+		std::vector<Entity> reorderedEntities = std::vector<Entity>(size);
+		for(size_t i = 0; i < size; i++)
+		{
+			reorderedEntities[i] = entities[order[i]];
+		}
+		entities = std::move(reorderedEntities);
+	}
+
 private:
 	ArchetypeId id;
 	size_t size = 0;
+	std::vector<Entity> entities = {};
 	std::vector<ComponentData> components = {};
 };
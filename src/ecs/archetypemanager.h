@@ -193,6 +193,41 @@ class ArchetypeManager
 		}
 	}
 
+	template<typename Func, typename... Components>
+	void QueryEntityComponentsChunked(Func&& entityFunc, size_t chunkSize)
+	{
+		constexpr size_t numComps = sizeof...(Components);
+		std::vector<std::pair<ArchetypeId, std::array<size_t, numComps>>> archs = QueryArchetypes<Components...>();
+
+		for(auto& [id, indices] : archs)
+		{
+			auto [comps, compCount] = QueryComponentData<Components...>(id, indices);
+			const Entity* entities = archetypes[id]->Entities();
+			for(size_t i = 0; i < compCount; i += chunkSize)
+			{
+				size_t currentChunkSize = std::min(compCount - i, chunkSize);
+				std::apply(entityFunc, std::tuple_cat(std::make_tuple(entities), comps, std::make_tuple(currentChunkSize)));
+
+				entities += chunkSize;
+				((std::get<Components*>(comps) += chunkSize), ...);
+			}
+		}
+	}
+
+	template<typename Func, typename... Components>
+	void QueryArchetypeEntityComponents(Func&& archetypeFunc)
+	{
+		constexpr size_t numComps = sizeof...(Components);
+		std::vector<std::pair<ArchetypeId, std::array<size_t, numComps>>> archs = QueryArchetypes<Components...>();
+
+		for(auto& [id, indices] : archs)
+		{
+			auto [comps, compCount] = QueryComponentData<Components...>(id, indices);
+			const Entity* entities = archetypes[id]->Entities();
+			std::apply([&](Components*... c) { archetypeFunc(id, entities, c..., compCount); }, comps);
+		}
+	}
+
 	template<size_t START, size_t COUNT, typename... Components, size_t... Indices>
 	static constexpr void IncCompPtrSeq(std::tuple<Components*...>& comps, std::ptrdiff_t inc, std::index_sequence<Indices...>)
 	{
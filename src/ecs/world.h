@@ -8,6 +8,7 @@
 #include <vector>
 #include <array>
 #include <unordered_map>
+#include <map>
 #include <memory>
 #include <algorithm>
 #include <type_traits>
@@ -74,6 +75,13 @@ public:
 		archManager.QueryComponentsChunked<Func, Components...>(std::forward<Func>(entityFunc), chunkSize);
 	}
 
+	template<typename... Components, typename Func>
+		requires (ComponentDerived<Components>&&...) && (sizeof...(Components) > 0) && std::is_invocable_r_v<void, Func, const Entity*, Components*..., size_t>
+	void QueryEntitiesChunked(size_t chunkSize, Func&& entityFunc)
+	{
+		archManager.QueryEntityComponentsChunked<Func, Components...>(std::forward<Func>(entityFunc), chunkSize);
+	}
+
 	template<typename... Components, typename Func>
 		requires (ComponentDerived<Components>&&...) && (sizeof...(Components) > 0) && std::is_invocable_r_v<void, Func, Components&..., Components&...>
 	void QueryPairs(Func&& entityFunc)
@@ -81,6 +89,37 @@ public:
 		archManager.QueryComponentPairs<Func, Components...>(std::forward<Func>(entityFunc));
 	}
 
+	//Calls the function once for every archetype matching the components, with the id of the archetype, all its entities and their components
+	//The order archetypes are visited in isn't stable, the id is
+	template<typename... Components, typename Func>
+		requires (ComponentDerived<Components>&&...) && (sizeof...(Components) > 0) && std::is_invocable_r_v<void, Func, const ArchetypeId&, const Entity*, Components*..., size_t>
+	void QueryArchetypeEntities(Func&& archetypeFunc)
+	{
+		archManager.QueryArchetypeEntityComponents<Func, Components...>(std::forward<Func>(archetypeFunc));
+	}
+
+	//Reorders the entities of the archetypes in orders, the order of an archetype moves the entity at order[i] to index i
+	//Archetypes without an order or with an empty one are left untouched
+	void Reorder(const std::map<ArchetypeId, std::vector<uint32_t>>& orders)
+	{
+		for(const auto& [id, order] : orders)
+		{
+			auto it = archManager.archetypes.find(id);
+			if(it == archManager.archetypes.end() || order.empty())
+			{
+				continue;
+			}
+
+			const std::shared_ptr<Archetype>& archetype = it->second;
+			archetype->Reorder(order);
+			const Entity* archEntities = archetype->Entities();
+			for(size_t k = 0; k < order.size(); k++)
+			{
+				entities.at(archEntities[k]).index = k;
+			}
+		}
+	}
+
 	template<typename Component, typename Func>
 		requires ComponentDerived<Component>&& std::is_invocable_v<Func, std::span<const Component>>
 	void WithAllOfComponent(Func&& componentFunc)
@@ -0,0 +1,102 @@
+#include "colliderobject.h"
+#include "renderer/graphics.h"
+#include "utils/nameof.h"
+#include "imgui.h"
+#include "guihelper.h"
+#include <algorithm>
+
+void ColliderObject::Render(float dt, const std::optional<Color>& color) const
+{
+	Color c = (ignColTimer -= dt) > 0.0f ? this->color : color.value_or(this->color);
+	float halfThickness = settings.thickness * 0.5f;
+	for(const auto& [from, to] : settings.Segments(position))
+	{
+		Vector2 dir = to - from;
+		dir.Normalize();
+		Vector2 side = Vector2(-dir.y, dir.x) * halfThickness;
+		Graphics::Line(from, to, c.WithAlpha(0.5f));
+		Graphics::Line(from + side, to + side, c);
+		Graphics::Line(from - side, to - side, c);
+	}
+}
+
+bool ColliderObject::IsHovered(Vector2 mousePos) const
+{
+	float range = std::max(settings.thickness * 0.5f, 2.5f);
+	for(const auto& [from, to] : settings.Segments(position))
+	{
+		Vector2 dir = to - from;
+		float len = dir.Normalize();
+		float dot = std::clamp(Vector2::Dot(mousePos - from, dir), 0.0f, len);
+		if(Vector2::Distance(from + dir * dot, mousePos) <= range)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+EditResult ColliderObject::Edit()
+{
+	ImGui::LabelText("", "Shape");
+	GuiHelper::EnumDropdown("##shape", &settings.shape);
+
+	if(settings.shape == ColliderShape::Segment)
+	{
+		ImGui::LabelText("", "Length");
+		GuiHelper::ClampedFloatInput("##length", &settings.length, "%0.2f", minSize, maxSize);
+	}
+	else if(settings.shape == ColliderShape::Polygon)
+	{
+		ImGui::LabelText("", "Sides");
+		ImGui::SliderScalar("##sides", ImGuiDataType_U32, &settings.sides, &minSides, &maxSides);
+
+		ImGui::LabelText("", "Radius");
+		GuiHelper::ClampedFloatInput("##polygonRadius", &settings.polygonRadius, "%0.2f", minSize, maxSize * 0.5f);
+	}
+
+	ImGui::LabelText("", "Rotation");
+	ImGui::SliderFloat("##rotation", &settings.rotation, -360.0f, 360.0f, "%0.2f");
+
+	ImGui::LabelText("", "Thickness");
+	GuiHelper::ClampedFloatInput("##thickness", &settings.thickness, "%0.2f", minThickness, maxThickness);
+
+	ImGui::LabelText("", "Color");
+	if(ImGui::ColorEdit4("##colorInput", &color.r, GuiHelper::defaultColorEditFlags))
+	{
+		ignColTimer = 2.0f;
+	}
+
+	ImGui::Spacing();
+	int result = GuiHelper::HorizontalButtonSplit("Delete", "Duplicate");
+	if(result > 0)
+	{
+		ignColTimer = 0.0;
+	}
+	return static_cast<EditResult>(result);
+}
+
+JsonObj ColliderObject::Serialize() const
+{
+	JsonObj json = SceneObject::Serialize();
+	json[NAMEOF(settings.shape)] = magic_enum::enum_name(settings.shape);
+	json[NAMEOF(settings.length)] = settings.length;
+	json[NAMEOF(settings.sides)] = settings.sides;
+	json[NAMEOF(settings.polygonRadius)] = settings.polygonRadius;
+	json[NAMEOF(settings.rotation)] = settings.rotation;
+	json[NAMEOF(settings.thickness)] = settings.thickness;
+	json[NAMEOF(color)] = SerializationHelper::Serialize(color);
+	return json;
+}
+
+void ColliderObject::Deserialize(const JsonObj& json)
+{
+	SceneObject::Deserialize(json);
+	settings.shape = magic_enum::enum_cast<ColliderShape>(static_cast<std::string>(json[NAMEOF(settings.shape)])).value();
+	settings.length = json[NAMEOF(settings.length)];
+	settings.sides = json[NAMEOF(settings.sides)];
+	settings.polygonRadius = json[NAMEOF(settings.polygonRadius)];
+	settings.rotation = json[NAMEOF(settings.rotation)];
+	settings.thickness = json[NAMEOF(settings.thickness)];
+	color = SerializationHelper::Deserialize<Color>(json[NAMEOF(color)]);
+}
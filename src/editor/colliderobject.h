@@ -0,0 +1,38 @@
+#pragma once
+#include "sceneobject.h"
+#include "serialization/serializationhelper.h"
+#include "simulation/collidersettings.h"
+#include "structs/color.h"
+
+class ColliderObject : public CloneableSceneObject<ColliderObject>
+{
+	friend class Scene;
+
+public:
+	static inline const float minSize = 10.0f;
+	static inline const float maxSize = 2000.0f;
+	static inline const float minThickness = 1.0f;
+	static inline const float maxThickness = 50.0f;
+	static inline const uint32_t minSides = 3;
+	static inline const uint32_t maxSides = 32;
+
+	ColliderObject(Vector2 position) : CloneableSceneObject(position) {}
+	ColliderObject() {}
+
+	const ColliderSettings& Settings() const { return settings; }
+	const Color& Col() const { return color; }
+
+	SceneObjectType ObjType() const override { return SceneObjectType::Collider; }
+	void Render(float dt, const std::optional<Color>& color) const override;
+	bool IsHovered(Vector2 mousePos) const override;
+	EditResult Edit() override;
+
+	JsonObj Serialize() const override;
+	void Deserialize(const JsonObj& json) override;
+
+private:
+	ColliderSettings settings;
+	Color color = Color::white;
+
+	mutable float ignColTimer = 0.0;
+};
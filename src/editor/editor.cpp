@@ -5,6 +5,7 @@
 #include "spawnerobject.h"
 #include "linkobject.h"
 #include "forcefieldobject.h"
+#include "colliderobject.h"
 #include "serialization/serializable.h"
 #include "renderer/graphics.h"
 #include "engine/input.h"
@@ -469,6 +470,10 @@ void Editor::AddMenu()
 	{
 		CreatePreview(std::make_unique<ForceFieldObject>());
 	}
+	if(ImGui::MenuItem("Collider", ""))
+	{
+		CreatePreview(std::make_unique<ColliderObject>());
+	}
 }
 
 void Editor::ControlsMenu()
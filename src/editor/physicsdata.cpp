@@ -6,6 +6,7 @@
 #include "imgui.h"
 #include <cmath>
 #include <algorithm>
+#include <string>
 
 PhysicsData::PhysicsData(const SolverSettings& settings) : settings(settings)
 {
@@ -28,8 +29,33 @@ JsonObj PhysicsData::Serialize() const
 	json[NAMEOF(settings.updateMode)] = magic_enum::enum_name(settings.updateMode);
 	json[NAMEOF(settings.timestep)] = settings.timestep;
 	json[NAMEOF(settings.substeps)] = settings.substeps;
+	json[NAMEOF(settings.adaptiveSubsteps)] = settings.adaptiveSubsteps;
+	json[NAMEOF(settings.minSubsteps)] = settings.minSubsteps;
+	json[NAMEOF(settings.maxSubsteps)] = settings.maxSubsteps;
+	json[NAMEOF(settings.multiRateSubsteps)] = settings.multiRateSubsteps;
+	json[NAMEOF(settings.maxSubstepStride)] = settings.maxSubstepStride;
 	json[NAMEOF(settings.gravity)] = SerializationHelper::Serialize(settings.gravity);
 	json[NAMEOF(settings.collision)] = settings.collision;
+	json[NAMEOF(settings.collisionMode)] = magic_enum::enum_name(settings.collisionMode);
+	json[NAMEOF(settings.relaxation)] = settings.relaxation;
+	json[NAMEOF(settings.adaptiveIterations)] = settings.adaptiveIterations;
+	json[NAMEOF(settings.maxIterations)] = settings.maxIterations;
+	json[NAMEOF(settings.overlapTolerance)] = settings.overlapTolerance;
+	json[NAMEOF(settings.autoPartitioning)] = settings.autoPartitioning;
+	json[NAMEOF(settings.neighborLists)] = settings.neighborLists;
+	json[NAMEOF(settings.neighborSkin)] = settings.neighborSkin;
+	json[NAMEOF(settings.temporalBlocking)] = settings.temporalBlocking;
+	json[NAMEOF(settings.blockSubsteps)] = settings.blockSubsteps;
+	json[NAMEOF(settings.continuousCollision)] = settings.continuousCollision;
+	json[NAMEOF(settings.ccdThreshold)] = settings.ccdThreshold;
+	json[NAMEOF(settings.reorderInterval)] = settings.reorderInterval;
+	json[NAMEOF(settings.sleeping)] = settings.sleeping;
+	json[NAMEOF(settings.sleepVelocity)] = settings.sleepVelocity;
+	json[NAMEOF(settings.sleepTime)] = settings.sleepTime;
+	json[NAMEOF(settings.bakeForceFields)] = settings.bakeForceFields;
+	json[NAMEOF(settings.forceFieldResolution)] = settings.forceFieldResolution;
+	json[NAMEOF(settings.deterministic)] = settings.deterministic;
+	json[NAMEOF(settings.seed)] = settings.seed;
 	return json;
 }
 
@@ -38,16 +64,44 @@ void PhysicsData::Deserialize(const JsonObj& json)
 	settings.updateMode = magic_enum::enum_cast<SolverUpdateMode>(static_cast<std::string>(json[NAMEOF(settings.updateMode)])).value();
 	settings.timestep = json[NAMEOF(settings.timestep)];
 	settings.substeps = json[NAMEOF(settings.substeps)];
+	settings.adaptiveSubsteps = json.value(NAMEOF(settings.adaptiveSubsteps), settings.adaptiveSubsteps);
+	settings.minSubsteps = json.value(NAMEOF(settings.minSubsteps), settings.minSubsteps);
+	settings.maxSubsteps = json.value(NAMEOF(settings.maxSubsteps), settings.maxSubsteps);
+	settings.multiRateSubsteps = json.value(NAMEOF(settings.multiRateSubsteps), settings.multiRateSubsteps);
+	settings.maxSubstepStride = json.value(NAMEOF(settings.maxSubstepStride), settings.maxSubstepStride);
 	settings.gravity = SerializationHelper::Deserialize<Vector2>(json[NAMEOF(settings.gravity)]);
 	settings.collision = json[NAMEOF(settings.collision)];
+	settings.collisionMode = magic_enum::enum_cast<SolverCollisionMode>(json.value(NAMEOF(settings.collisionMode), std::string(magic_enum::enum_name(settings.collisionMode)))).value_or(settings.collisionMode);
+	settings.relaxation = json.value(NAMEOF(settings.relaxation), settings.relaxation);
+	settings.adaptiveIterations = json.value(NAMEOF(settings.adaptiveIterations), settings.adaptiveIterations);
+	settings.maxIterations = json.value(NAMEOF(settings.maxIterations), settings.maxIterations);
+	settings.overlapTolerance = json.value(NAMEOF(settings.overlapTolerance), settings.overlapTolerance);
+	settings.autoPartitioning = json.value(NAMEOF(settings.autoPartitioning), settings.autoPartitioning);
+	settings.neighborLists = json.value(NAMEOF(settings.neighborLists), settings.neighborLists);
+	settings.neighborSkin = json.value(NAMEOF(settings.neighborSkin), settings.neighborSkin);
+	settings.temporalBlocking = json.value(NAMEOF(settings.temporalBlocking), settings.temporalBlocking);
+	settings.blockSubsteps = json.value(NAMEOF(settings.blockSubsteps), settings.blockSubsteps);
+	settings.continuousCollision = json.value(NAMEOF(settings.continuousCollision), settings.continuousCollision);
+	settings.ccdThreshold = json.value(NAMEOF(settings.ccdThreshold), settings.ccdThreshold);
+	settings.reorderInterval = json.value(NAMEOF(settings.reorderInterval), settings.reorderInterval);
+	settings.sleeping = json.value(NAMEOF(settings.sleeping), settings.sleeping);
+	settings.sleepVelocity = json.value(NAMEOF(settings.sleepVelocity), settings.sleepVelocity);
+	settings.sleepTime = json.value(NAMEOF(settings.sleepTime), settings.sleepTime);
+	settings.bakeForceFields = json.value(NAMEOF(settings.bakeForceFields), settings.bakeForceFields);
+	settings.forceFieldResolution = json.value(NAMEOF(settings.forceFieldResolution), settings.forceFieldResolution);
+	settings.deterministic = json.value(NAMEOF(settings.deterministic), settings.deterministic);
+	settings.seed = json.value(NAMEOF(settings.seed), settings.seed);
 }
 
 void PhysicsData::Edit()
 {
+	//Deterministic mode steps the simulation with the fixed timestep itself, which leaves the solver one step per update in any mode
+	ImGui::BeginDisabled(settings.deterministic);
 	ImGui::LabelText("", "Update mode");
 	GuiHelper::EnumDropdown("##updateModeCombo", &settings.updateMode);
+	ImGui::EndDisabled();
 
-	ImGui::BeginDisabled(settings.updateMode == SolverUpdateMode::FrameDeltaTime);
+	ImGui::BeginDisabled(settings.updateMode == SolverUpdateMode::FrameDeltaTime && !settings.deterministic);
 	ImGui::LabelText("", "Simulation steps per second");
 	int sps = static_cast<int>(std::roundf(1.0f / settings.timestep));
 	if(ImGui::InputInt("##spsInput", &sps, 0, 0))
@@ -56,12 +110,39 @@ void PhysicsData::Edit()
 	}
 	ImGui::EndDisabled();
 
+	ImGui::BeginDisabled(settings.adaptiveSubsteps);
 	ImGui::LabelText("", "Substeps");
 	int substeps = settings.substeps;
 	if(ImGui::InputInt("##substepsInput", &substeps, 0, 0))
 	{
 		settings.substeps = static_cast<uint32_t>(std::clamp(substeps, 1, 16));
 	}
+	ImGui::EndDisabled();
+
+	ImGui::LabelText("", "Adaptive substeps");
+	ImGui::Checkbox("##adaptiveSubstepsToggle", &settings.adaptiveSubsteps);
+
+	ImGui::BeginDisabled(!settings.adaptiveSubsteps);
+	ImGui::LabelText("", "Substep range");
+	int substepRange[2] = { static_cast<int>(settings.minSubsteps), static_cast<int>(settings.maxSubsteps) };
+	if(ImGui::InputInt2("##substepRangeInput", substepRange))
+	{
+		settings.minSubsteps = static_cast<uint32_t>(std::clamp(substepRange[0], 1, 16));
+		settings.maxSubsteps = static_cast<uint32_t>(std::clamp(substepRange[1], static_cast<int>(settings.minSubsteps), 16));
+	}
+	ImGui::EndDisabled();
+
+	ImGui::LabelText("", "Multi rate substeps");
+	ImGui::Checkbox("##multiRateSubstepsToggle", &settings.multiRateSubsteps);
+
+	ImGui::BeginDisabled(!settings.multiRateSubsteps);
+	ImGui::LabelText("", "Max substep stride");
+	int maxSubstepStride = settings.maxSubstepStride;
+	if(ImGui::InputInt("##maxSubstepStrideInput", &maxSubstepStride, 0, 0))
+	{
+		settings.maxSubstepStride = static_cast<uint32_t>(std::clamp(maxSubstepStride, 1, 16));
+	}
+	ImGui::EndDisabled();
 
 	ImGui::Spacing();
 	ImGui::LabelText("", "Gravity");
@@ -69,4 +150,117 @@ void PhysicsData::Edit()
 
 	ImGui::LabelText("", "Collisions");
 	ImGui::Checkbox("##collisionsToggle", &settings.collision);
+
+	ImGui::BeginDisabled(!settings.collision);
+	ImGui::LabelText("", "Collision mode");
+	GuiHelper::EnumDropdown("##collisionModeCombo", &settings.collisionMode);
+	ImGui::BeginDisabled(settings.collisionMode != SolverCollisionMode::Jacobi);
+	ImGui::LabelText("", "Relaxation");
+	if(ImGui::InputFloat("##relaxationInput", &settings.relaxation, 0.0f, 0.0f, "%.2f"))
+	{
+		settings.relaxation = std::clamp(settings.relaxation, 0.1f, 2.0f);
+	}
+	ImGui::EndDisabled();
+
+	ImGui::LabelText("", "Adaptive iterations");
+	ImGui::Checkbox("##adaptiveIterationsToggle", &settings.adaptiveIterations);
+	ImGui::BeginDisabled(!settings.adaptiveIterations);
+	ImGui::LabelText("", "Max iterations");
+	int maxIterations = settings.maxIterations;
+	if(ImGui::InputInt("##maxIterationsInput", &maxIterations, 0, 0))
+	{
+		settings.maxIterations = static_cast<uint32_t>(std::clamp(maxIterations, 1, 16));
+	}
+	ImGui::LabelText("", "Overlap tolerance");
+	if(ImGui::InputFloat("##overlapToleranceInput", &settings.overlapTolerance, 0.0f, 0.0f, "%.3f"))
+	{
+		settings.overlapTolerance = std::clamp(settings.overlapTolerance, 0.001f, 0.5f);
+	}
+	ImGui::EndDisabled();
+	ImGui::EndDisabled();
+
+	ImGui::LabelText("", "Auto tune partitioning");
+	ImGui::Checkbox("##autoPartitioningToggle", &settings.autoPartitioning);
+
+	ImGui::BeginDisabled(!settings.collision);
+	ImGui::LabelText("", "Neighbor lists");
+	ImGui::Checkbox("##neighborListsToggle", &settings.neighborLists);
+	ImGui::BeginDisabled(!settings.neighborLists);
+	ImGui::LabelText("", "Neighbor skin");
+	if(ImGui::InputFloat("##neighborSkinInput", &settings.neighborSkin, 0.0f, 0.0f, "%.1f"))
+	{
+		settings.neighborSkin = std::clamp(settings.neighborSkin, 0.1f, 50.0f);
+	}
+	ImGui::LabelText("", "Temporal blocking");
+	ImGui::Checkbox("##temporalBlockingToggle", &settings.temporalBlocking);
+	ImGui::BeginDisabled(!settings.temporalBlocking);
+	ImGui::LabelText("", "Substeps per block");
+	int blockSubsteps = settings.blockSubsteps;
+	if(ImGui::InputInt("##blockSubstepsInput", &blockSubsteps, 0, 0))
+	{
+		settings.blockSubsteps = static_cast<uint32_t>(std::clamp(blockSubsteps, 1, 16));
+	}
+	ImGui::EndDisabled();
+	ImGui::EndDisabled();
+
+	ImGui::LabelText("", "Continuous collision");
+	ImGui::Checkbox("##continuousCollisionToggle", &settings.continuousCollision);
+	ImGui::BeginDisabled(!settings.continuousCollision);
+	ImGui::LabelText("", "Sweep threshold (radius)");
+	if(ImGui::InputFloat("##ccdThresholdInput", &settings.ccdThreshold, 0.0f, 0.0f, "%.2f"))
+	{
+		settings.ccdThreshold = std::clamp(settings.ccdThreshold, 0.05f, 10.0f);
+	}
+	ImGui::EndDisabled();
+	ImGui::EndDisabled();
+
+	ImGui::Spacing();
+	ImGui::LabelText("", "Memory reorder interval (frames)");
+	int reorderInterval = settings.reorderInterval;
+	if(ImGui::InputInt("##reorderIntervalInput", &reorderInterval, 0, 0))
+	{
+		settings.reorderInterval = static_cast<uint32_t>(std::clamp(reorderInterval, 0, 10000));
+	}
+
+	ImGui::Spacing();
+	ImGui::LabelText("", "Sleeping");
+	ImGui::Checkbox("##sleepingToggle", &settings.sleeping);
+
+	ImGui::BeginDisabled(!settings.sleeping);
+	ImGui::LabelText("", "Sleep velocity");
+	if(ImGui::InputFloat("##sleepVelocityInput", &settings.sleepVelocity, 0.0f, 0.0f, "%.1f"))
+	{
+		settings.sleepVelocity = std::max(settings.sleepVelocity, 0.0f);
+	}
+	ImGui::LabelText("", "Sleep time (s)");
+	if(ImGui::InputFloat("##sleepTimeInput", &settings.sleepTime, 0.0f, 0.0f, "%.2f"))
+	{
+		settings.sleepTime = std::max(settings.sleepTime, 0.0f);
+	}
+	ImGui::EndDisabled();
+
+	ImGui::Spacing();
+	ImGui::LabelText("", "Bake force fields");
+	ImGui::Checkbox("##bakeForceFieldsToggle", &settings.bakeForceFields);
+
+	ImGui::BeginDisabled(!settings.bakeForceFields);
+	ImGui::LabelText("", "Bake resolution (units per texel)");
+	if(ImGui::InputFloat("##forceFieldResolutionInput", &settings.forceFieldResolution, 0.0f, 0.0f, "%.1f"))
+	{
+		settings.forceFieldResolution = std::clamp(settings.forceFieldResolution, 0.5f, 100.0f);
+	}
+	ImGui::EndDisabled();
+
+	ImGui::Spacing();
+	ImGui::LabelText("", "Deterministic");
+	ImGui::Checkbox("##deterministicToggle", &settings.deterministic);
+
+	ImGui::BeginDisabled(!settings.deterministic);
+	ImGui::LabelText("", "Seed");
+	int seed = static_cast<int>(settings.seed);
+	if(ImGui::InputInt("##seedInput", &seed, 0, 0))
+	{
+		settings.seed = static_cast<uint32_t>(std::max(seed, 0));
+	}
+	ImGui::EndDisabled();
 }
@@ -3,12 +3,14 @@
 #include "spawnerobject.h"
 #include "linkobject.h"
 #include "forcefieldobject.h"
+#include "colliderobject.h"
 #include "core/rectworld.h"
 #include "core/circleworld.h"
 #include "utils/nameof.h"
 #include "connectionplacement.h"
 #include "magic_enum.hpp"
 #include <algorithm>
+#include <cmath>
 
 std::unique_ptr<World> Scene::CreateWorld() const
 {
@@ -27,6 +29,7 @@ Simulation Scene::CreateSimulation() const
 {
 	SolverSettings settings = this->physics.Settings();
 	settings.partitioningSize = ParticleObject::maxSize * 2.0f;
+	settings.partitioningLevels = static_cast<uint32_t>(std::log2f(ParticleObject::maxSize / ParticleObject::minSize));
 	Simulation sim = Simulation(CreateWorld(), settings);
 	std::vector<std::shared_ptr<SceneObject>> objects = this->objects;
 	std::sort(objects.begin(), objects.end(), [](const std::shared_ptr<SceneObject>& a, const std::shared_ptr<SceneObject>& b)
@@ -61,6 +64,15 @@ Simulation Scene::CreateSimulation() const
 				sim.AddForceField(ForceField(f.Settings(), obj->position), obj->id);
 				break;
 			}
+			case SceneObjectType::Collider:
+			{
+				ColliderObject& c = static_cast<ColliderObject&>(*obj);
+				for(const auto& [from, to] : c.Settings().Segments(obj->position))
+				{
+					sim.AddCollider(Collider(from, to, c.Settings().thickness * 0.5f), c.Col());
+				}
+				break;
+			}
 			default:
 				continue;
 		}
@@ -148,6 +160,9 @@ void Scene::Deserialize(const JsonObj& json)
 			case SceneObjectType::ForceField:
 				obj = std::make_shared<ForceFieldObject>();
 				break;
+			case SceneObjectType::Collider:
+				obj = std::make_shared<ColliderObject>();
+				break;
 			default:
 				throw std::exception("Unknown SceneObjectType!");
 		}
@@ -18,7 +18,8 @@ enum class SceneObjectType
 	Particle,
 	Spawner,
 	Link,
-	ForceField
+	ForceField,
+	Collider
 };
 
 class SceneObject : public ISerializable
@@ -0,0 +1,74 @@
+#pragma once
+#include "structs/vector2.h"
+#include "ecs/threadpool.h"
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+//Force sampled on a regular grid of points over the world bounds, read back with bilinear interpolation
+class BakedForceField
+{
+public:
+	BakedForceField(Vector2 min, Vector2 max, float texelSize) : bMin(min), texelSize(texelSize)
+	{
+		texelsX = std::max(static_cast<int32_t>(std::ceilf((max - min).x / texelSize)), 1);
+		texelsY = std::max(static_cast<int32_t>(std::ceilf((max - min).y / texelSize)), 1);
+		pointsX = texelsX + 1;
+		forceX = std::vector<float>(static_cast<size_t>(pointsX) * (texelsY + 1), 0.0f);
+		forceY = std::vector<float>(forceX.size(), 0.0f);
+	}
+
+	//Fills every sample point with sample(pos), rows are spread over the thread pool
+	template<typename Func>
+	void Bake(Func&& sample, ThreadPool& threadPool)
+	{
+		for(const auto& [offset, amount] : ThreadPool::SplitWork(texelsY + 1, threadPool.ThreadCount()))
+		{
+			if(amount == 0)
+			{
+				continue;
+			}
+
+			threadPool.EnqueueJob([this, &sample, offset, amount]
+			{
+				for(size_t y = offset; y < offset + amount; y++)
+				{
+					for(int32_t x = 0; x < pointsX; x++)
+					{
+						const Vector2 force = sample(bMin + Vector2(static_cast<float>(x), static_cast<float>(y)) * texelSize);
+						forceX[y * pointsX + x] = force.x;
+						forceY[y * pointsX + x] = force.y;
+					}
+				}
+			});
+		}
+		threadPool.WaitForCompletion();
+	}
+
+	Vector2 Sample(Vector2 pos) const
+	{
+		const float fx = std::clamp((pos.x - bMin.x) / texelSize, 0.0f, static_cast<float>(texelsX));
+		const float fy = std::clamp((pos.y - bMin.y) / texelSize, 0.0f, static_cast<float>(texelsY));
+		const int32_t x = std::min(static_cast<int32_t>(fx), texelsX - 1);
+		const int32_t y = std::min(static_cast<int32_t>(fy), texelsY - 1);
+		const float tx = fx - static_cast<float>(x);
+		const float ty = fy - static_cast<float>(y);
+
+		const size_t i = static_cast<size_t>(y) * pointsX + x;
+		const float bottomX = forceX[i] + (forceX[i + 1] - forceX[i]) * tx;
+		const float topX = forceX[i + pointsX] + (forceX[i + pointsX + 1] - forceX[i + pointsX]) * tx;
+		const float bottomY = forceY[i] + (forceY[i + 1] - forceY[i]) * tx;
+		const float topY = forceY[i + pointsX] + (forceY[i + pointsX + 1] - forceY[i + pointsX]) * tx;
+		return Vector2(bottomX + (topX - bottomX) * ty, bottomY + (topY - bottomY) * ty);
+	}
+
+private:
+	std::vector<float> forceX = {};
+	std::vector<float> forceY = {};
+	Vector2 bMin;
+	float texelSize;
+	int32_t texelsX;
+	int32_t texelsY;
+	int32_t pointsX;
+};
@@ -1,13 +1,31 @@
 #pragma once
 #include "structs/vector2.h"
-#include "simulation/components/particle.h"
+#include "utils/cpu.h"
+#include <cstdint>
 #include <utility>
 
+//Particles constrained in one call, in structure of arrays layout
+struct ConstraintBatch
+{
+	float* posX;
+	float* posY;
+	float* prevX;
+	float* prevY;
+	const float* radius;
+	const float* bounciness;
+	size_t count;
+};
+
+class IConstraint;
+//Constrains a whole batch, the constraint passed in has to be the one the kernel was taken from
+using ConstraintKernel = void(*)(const IConstraint& constraint, const ConstraintBatch& batch);
+
 class IConstraint
 {
 public:
 	virtual ~IConstraint() { };
 
-	virtual void Contrain(Vector2& pos, Particle& p) const = 0;
+	//Resolved once per step, so particles aren't constrained through a virtual call each
+	virtual ConstraintKernel BatchKernel(SimdLevel level) const = 0;
 	virtual std::pair<Vector2, Vector2> Bounds() const = 0;
 };
@@ -0,0 +1,192 @@
+#include "forcefieldgrid.h"
+#include "utils/math.h"
+#include <array>
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+
+void ForceFieldGrid::Build(std::vector<ForceFieldKernels::PreparedField>&& prepared, Vector2 min, Vector2 max, int32_t countX, int32_t countY)
+{
+	//Fields using the same kernel run back to back, done once here instead of for every block of particles
+	fields = std::move(prepared);
+	std::stable_sort(fields.begin(), fields.end(), [](const ForceFieldKernels::PreparedField& a, const ForceFieldKernels::PreparedField& b)
+	{
+		return a.config < b.config;
+	});
+	bMin = min;
+	cellsX = std::max(countX, 1);
+	cellsY = std::max(countY, 1);
+	cellScale = Vector2(static_cast<float>(cellsX) / (max - min).x, static_cast<float>(cellsY) / (max - min).y);
+
+	//Counting sort of the fields into every cell their bounds touch
+	auto forEachCell = [&](const ForceFieldKernels::PreparedField& field, auto&& func)
+	{
+		const auto [x0, y0] = CellCoords(field.min);
+		const auto [x1, y1] = CellCoords(field.max);
+		for(int32_t cx = x0; cx <= x1; cx++)
+		{
+			for(int32_t cy = y0; cy <= y1; cy++)
+			{
+				func(static_cast<uint32_t>(cx * cellsY + cy));
+			}
+		}
+	};
+
+	const size_t cellCount = static_cast<size_t>(cellsX) * cellsY;
+	std::vector<uint32_t> cellStart = std::vector<uint32_t>(cellCount + 1, 0);
+	for(const ForceFieldKernels::PreparedField& field : fields)
+	{
+		forEachCell(field, [&](uint32_t cell) { cellStart[cell + 1]++; });
+	}
+	std::inclusive_scan(cellStart.begin(), cellStart.end(), cellStart.begin());
+
+	std::vector<uint32_t> cellFields = std::vector<uint32_t>(cellStart.back());
+	std::vector<uint32_t> fill = std::vector<uint32_t>(cellStart.begin(), cellStart.end() - 1);
+	for(uint32_t field = 0; field < fields.size(); field++)
+	{
+		forEachCell(fields[field], [&](uint32_t cell) { cellFields[fill[cell]++] = field; });
+	}
+
+	//Large fields cover many cells with the same list, sharing it lets the particles of all those cells run the kernels together
+	//A hash collision only costs a duplicate list
+	cellLists.assign(cellCount, 0);
+	listStart.assign(2, 0);
+	listFields.clear();
+	std::unordered_map<uint64_t, uint32_t> lists = {};
+	for(size_t cell = 0; cell < cellCount; cell++)
+	{
+		const uint32_t* begin = cellFields.data() + cellStart[cell];
+		const uint32_t count = cellStart[cell + 1] - cellStart[cell];
+		if(count == 0)
+		{
+			continue;
+		}
+
+		const uint64_t hash = Math::Fnv1a(begin, count * sizeof(uint32_t));
+		auto it = lists.find(hash);
+		if(it != lists.end())
+		{
+			const uint32_t list = it->second;
+			if(listStart[list + 1] - listStart[list] == count && std::equal(begin, begin + count, listFields.begin() + listStart[list]))
+			{
+				cellLists[cell] = list;
+				continue;
+			}
+		}
+
+		const uint32_t list = static_cast<uint32_t>(listStart.size() - 1);
+		listFields.insert(listFields.end(), begin, begin + count);
+		listStart.push_back(static_cast<uint32_t>(listFields.size()));
+		lists.emplace(hash, list);
+		cellLists[cell] = list;
+	}
+}
+
+void ForceFieldGrid::Accumulate(const float* x, const float* y, const float* invMass, size_t count, float* accX, float* accY) const
+{
+	if(fields.empty())
+	{
+		return;
+	}
+
+	for(size_t block = 0; block < count; block += blockSize)
+	{
+		const size_t n = std::min(blockSize, count - block);
+		AccumulateBlock(x + block, y + block, invMass + block, n, accX + block, accY + block);
+	}
+}
+
+std::pair<int32_t, int32_t> ForceFieldGrid::CellCoords(Vector2 pos) const
+{
+	const int32_t cx = static_cast<int32_t>((pos.x - bMin.x) * cellScale.x);
+	const int32_t cy = static_cast<int32_t>((pos.y - bMin.y) * cellScale.y);
+	return std::make_pair(std::clamp(cx, 0, cellsX - 1), std::clamp(cy, 0, cellsY - 1));
+}
+
+void ForceFieldGrid::AccumulateBlock(const float* x, const float* y, const float* invMass, size_t count, float* accX, float* accY) const
+{
+	//Particles outside of all fields are left out right away
+	std::array<uint32_t, blockSize> particleLists = {};
+	std::array<uint32_t, blockSize> order = {};
+	size_t active = 0;
+	bool shared = true;
+	for(size_t i = 0; i < count; i++)
+	{
+		const auto [cx, cy] = CellCoords(Vector2(x[i], y[i]));
+		const uint32_t list = cellLists[cx * cellsY + cy];
+		particleLists[i] = list;
+		shared &= list == particleLists[0];
+		if(list != 0)
+		{
+			order[active++] = static_cast<uint32_t>(i);
+		}
+	}
+	if(active == 0)
+	{
+		return;
+	}
+
+	//Blocks of storage sorted along a z-order curve mostly fall into a single list and run the kernels in place
+	if(shared)
+	{
+		const uint32_t list = particleLists[0];
+		for(uint32_t f = listStart[list]; f < listStart[list + 1]; f++)
+		{
+			const ForceFieldKernels::PreparedField& field = fields[listFields[f]];
+			field.kernel(field, x, y, invMass, count, accX, accY);
+		}
+		return;
+	}
+
+	//Otherwise the particles are sorted by list, insertion sort is cheap for the few lists a block touches
+	for(size_t i = 1; i < active; i++)
+	{
+		const uint32_t index = order[i];
+		size_t k = i;
+		while(k > 0 && particleLists[order[k - 1]] > particleLists[index])
+		{
+			order[k] = order[k - 1];
+			k--;
+		}
+		order[k] = index;
+	}
+
+	std::array<float, blockSize> groupX = {};
+	std::array<float, blockSize> groupY = {};
+	std::array<float, blockSize> groupInvMass = {};
+	std::array<float, blockSize> groupAccX = {};
+	std::array<float, blockSize> groupAccY = {};
+	size_t begin = 0;
+	while(begin < active)
+	{
+		const uint32_t list = particleLists[order[begin]];
+		size_t end = begin + 1;
+		while(end < active && particleLists[order[end]] == list)
+		{
+			end++;
+		}
+
+		const size_t n = end - begin;
+		for(size_t k = 0; k < n; k++)
+		{
+			const uint32_t i = order[begin + k];
+			groupX[k] = x[i];
+			groupY[k] = y[i];
+			groupInvMass[k] = invMass[i];
+			groupAccX[k] = accX[i];
+			groupAccY[k] = accY[i];
+		}
+		for(uint32_t f = listStart[list]; f < listStart[list + 1]; f++)
+		{
+			const ForceFieldKernels::PreparedField& field = fields[listFields[f]];
+			field.kernel(field, groupX.data(), groupY.data(), groupInvMass.data(), n, groupAccX.data(), groupAccY.data());
+		}
+		for(size_t k = 0; k < n; k++)
+		{
+			const uint32_t i = order[begin + k];
+			accX[i] = groupAccX[k];
+			accY[i] = groupAccY[k];
+		}
+		begin = end;
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "forcefieldkernels.h"
+#include "structs/vector2.h"
+#include <cstdint>
+#include <vector>
+
+//Force fields listed per cell of a uniform grid by their bounds, so particles only evaluate the fields of their own cell
+//Cells overlapped by the same fields share one list, lists keep the fields sorted by kernel,
+//so the same kernel runs back to back
+class ForceFieldGrid
+{
+public:
+	//Sorts the fields by kernel and lists them per cell, only needed again once the fields or the cells change
+	void Build(std::vector<ForceFieldKernels::PreparedField>&& fields, Vector2 min, Vector2 max, int32_t countX, int32_t countY);
+	bool Empty() const { return fields.empty(); }
+	size_t FieldCount() const { return fields.size(); }
+	int32_t CellsX() const { return cellsX; }
+	int32_t CellsY() const { return cellsY; }
+	//Adds the force of every field to the accelerations, particles are grouped by list a block at a time and each group runs the kernels of its list
+	void Accumulate(const float* x, const float* y, const float* invMass, size_t count, float* accX, float* accY) const;
+
+private:
+	static constexpr size_t blockSize = 16;
+
+	std::vector<ForceFieldKernels::PreparedField> fields = {};
+	//List of every cell, list 0 is the empty one
+	std::vector<uint32_t> cellLists = {};
+	//Fields of list l are listFields[listStart[l]] to listFields[listStart[l + 1]]
+	std::vector<uint32_t> listStart = {};
+	std::vector<uint32_t> listFields = {};
+	Vector2 bMin = Vector2::zero;
+	Vector2 cellScale = Vector2::zero;
+	int32_t cellsX = 0;
+	int32_t cellsY = 0;
+
+	std::pair<int32_t, int32_t> CellCoords(Vector2 pos) const;
+	void AccumulateBlock(const float* x, const float* y, const float* invMass, size_t count, float* accX, float* accY) const;
+};
@@ -0,0 +1,170 @@
+#pragma once
+#include "simulation/components.h"
+#include "structs/vector2.h"
+#include <cstdint>
+#include <cmath>
+#include <array>
+#include <algorithm>
+#include <utility>
+
+//Force field evaluation over blocks of particles
+//Every combination of shape, direction, falloff and mass dependency gets its own kernel, so the loop over particles has no branches
+namespace ForceFieldKernels
+{
+	struct PreparedField;
+	using Kernel = void(*)(const PreparedField& field, const float* x, const float* y, const float* invMass, size_t count, float* accX, float* accY);
+
+	//Field settings turned into the constants its kernel needs
+	struct PreparedField
+	{
+		Kernel kernel;
+		//Index of the kernel, fields are sorted by it to run the same kernel back to back
+		uint32_t config;
+		Vector2 pos;
+		//Axis aligned bounds, used to skip blocks of particles
+		Vector2 min;
+		Vector2 max;
+		float force;
+		float sqrRange;
+		float invRange;
+		//Rotation into the local space of a rect
+		float cosRot;
+		float sinRot;
+		Vector2 halfSize;
+		Vector2 invHalfSize;
+		//World direction for fields not pushing away from their center
+		Vector2 dir;
+	};
+
+	constexpr float eps = 1e-5f;
+
+	template<ForceFieldFalloff F>
+	inline float Falloff(float x)
+	{
+		if constexpr(F == ForceFieldFalloff::Linear)
+		{
+			return x;
+		}
+		else if constexpr(F == ForceFieldFalloff::Quadratic)
+		{
+			return x * x;
+		}
+		else if constexpr(F == ForceFieldFalloff::Cubic)
+		{
+			return x * x * x;
+		}
+		else if constexpr(F == ForceFieldFalloff::Inverse)
+		{
+			return 1.0f - (1.0f - x) * (1.0f - x);
+		}
+		else if constexpr(F == ForceFieldFalloff::Smoothstep)
+		{
+			return x * x * (3.0f - 2.0f * x);
+		}
+		else
+		{
+			return 1.0f;
+		}
+	}
+
+	template<ForceFieldShape S, bool FromCenter, ForceFieldFalloff F, bool MassDependent>
+	void Evaluate(const PreparedField& field, const float* x, const float* y, const float* invMass, size_t count, float* accX, float* accY)
+	{
+		for(size_t i = 0; i < count; i++)
+		{
+			const float tx = x[i] - field.pos.x;
+			const float ty = y[i] - field.pos.y;
+			const float sqrDst = tx * tx + ty * ty;
+
+			bool inside;
+			float falloff = 1.0f;
+			if constexpr(S == ForceFieldShape::Circle)
+			{
+				inside = sqrDst <= field.sqrRange;
+				if constexpr(F != ForceFieldFalloff::None)
+				{
+					falloff = 1.0f - std::sqrt(sqrDst) * field.invRange;
+				}
+			}
+			else
+			{
+				const float lx = std::fabs(field.cosRot * tx - field.sinRot * ty);
+				const float ly = std::fabs(field.sinRot * tx + field.cosRot * ty);
+				inside = (lx <= field.halfSize.x) & (ly <= field.halfSize.y);
+				if constexpr(F != ForceFieldFalloff::None)
+				{
+					falloff = std::min(1.0f - lx * field.invHalfSize.x, 1.0f - ly * field.invHalfSize.y);
+				}
+			}
+			falloff = Falloff<F>(std::clamp(falloff, 0.0f, 1.0f));
+
+			float dirX = field.dir.x;
+			float dirY = field.dir.y;
+			if constexpr(FromCenter)
+			{
+				//Particles right at the center aren't pushed anywhere
+				inside &= sqrDst >= eps;
+				const float invDst = 1.0f / std::sqrt(std::max(sqrDst, eps));
+				dirX = tx * invDst;
+				dirY = ty * invDst;
+			}
+
+			float mag = inside ? field.force * falloff : 0.0f;
+			if constexpr(MassDependent)
+			{
+				mag *= invMass[i];
+			}
+			accX[i] += dirX * mag;
+			accY[i] += dirY * mag;
+		}
+	}
+
+	namespace Detail
+	{
+		constexpr size_t falloffCount = 6;
+		constexpr size_t configCount = 2 * 2 * falloffCount * 2;
+
+		template<size_t Config>
+		constexpr Kernel KernelOf()
+		{
+			constexpr ForceFieldShape shape = static_cast<ForceFieldShape>(Config / (2 * falloffCount * 2));
+			constexpr bool fromCenter = (Config / (falloffCount * 2)) % 2 != 0;
+			constexpr ForceFieldFalloff falloff = static_cast<ForceFieldFalloff>((Config / 2) % falloffCount);
+			constexpr bool massDependent = Config % 2 != 0;
+			return &Evaluate<shape, fromCenter, falloff, massDependent>;
+		}
+
+		template<size_t... Configs>
+		constexpr std::array<Kernel, sizeof...(Configs)> MakeKernels(std::index_sequence<Configs...>)
+		{
+			return { KernelOf<Configs>()... };
+		}
+
+		inline constexpr std::array<Kernel, configCount> kernels = MakeKernels(std::make_index_sequence<configCount>());
+	}
+
+	inline PreparedField Prepare(const ForceField& field)
+	{
+		const ForceFieldSettings& s = field.settings;
+		const bool fromCenter = s.direction == ForceFieldDirection::FromCenter;
+		const uint32_t config = ((static_cast<uint32_t>(s.shape) * 2 + (fromCenter ? 1 : 0)) * static_cast<uint32_t>(Detail::falloffCount)
+			+ static_cast<uint32_t>(s.falloff)) * 2 + (s.massDependent ? 1 : 0);
+
+		PreparedField prepared = {};
+		prepared.kernel = Detail::kernels[config];
+		prepared.config = config;
+		prepared.pos = field.pos;
+		prepared.min = field.pos - s.Extents();
+		prepared.max = field.pos + s.Extents();
+		prepared.force = s.force;
+		prepared.sqrRange = s.range * s.range;
+		prepared.invRange = 1.0f / std::max(s.range, eps);
+		const float rotation = -s.rectRotation * 0.0174533f;
+		prepared.cosRot = std::cos(rotation);
+		prepared.sinRot = std::sin(rotation);
+		prepared.halfSize = s.rectSize * 0.5f;
+		prepared.invHalfSize = Vector2(1.0f / std::max(prepared.halfSize.x, eps), 1.0f / std::max(prepared.halfSize.y, eps));
+		prepared.dir = s.shape == ForceFieldShape::Rect ? Vector2::Rotate(s.DirVector(), s.rectRotation) : s.DirVector();
+		return prepared;
+	}
+}
@@ -0,0 +1,170 @@
+#include "hierarchicalgrid.h"
+#include <algorithm>
+
+HierarchicalGrid::HierarchicalGrid(Vector2 min, Vector2 max, float cellSize, uint32_t levelCount) : staticLayer(min, max, cellSize), cellSize(cellSize)
+{
+	levels.reserve(std::max(levelCount, 1u));
+	levels.emplace_back(min, max, cellSize);
+	AddLevels(min, max, levelCount);
+}
+
+HierarchicalGrid::HierarchicalGrid(Vector2 min, Vector2 max, int32_t cellsX, int32_t cellsY, uint32_t levelCount)
+	: staticLayer(min, max, cellsX, cellsY), cellSize(std::min((max - min).x / static_cast<float>(cellsX), (max - min).y / static_cast<float>(cellsY)))
+{
+	levels.reserve(std::max(levelCount, 1u));
+	levels.emplace_back(min, max, cellsX, cellsY);
+	AddLevels(min, max, levelCount);
+}
+
+void HierarchicalGrid::AddLevels(Vector2 min, Vector2 max, uint32_t levelCount)
+{
+	levelCount = std::max(levelCount, 1u);
+	cellOffsets.push_back(0);
+	cellOffsets.push_back(levels[0].CellCount());
+	for(uint32_t i = 1; i < levelCount; i++)
+	{
+		//Exactly twice the cells of the previous level, so every cell has 4 children
+		levels.emplace_back(min, max, levels[0].CellsX() << i, levels[0].CellsY() << i);
+		cellOffsets.push_back(cellOffsets.back() + levels[i].CellCount());
+	}
+	levelParticles.resize(levelCount);
+	levelSubsets.resize(levelCount);
+}
+
+void HierarchicalGrid::AssignLevels(const float* radius, const uint8_t* flags, uint8_t staticFlags, size_t count)
+{
+	particleCount = count;
+	staticParticles.clear();
+	for(size_t i = 0; i < count; i++)
+	{
+		if((flags[i] & staticFlags) != 0)
+		{
+			staticParticles.push_back(static_cast<uint32_t>(i));
+		}
+	}
+	staticDirty = true;
+
+	//Without static particles a single level bins all particles directly
+	if(levels.size() == 1 && staticParticles.empty())
+	{
+		return;
+	}
+
+	//Cells of at least two diameters keep a few particles per cell, which the batched narrow phase needs to pay off
+	const uint32_t lastLevel = LevelCount() - 1;
+	particleLevels.resize(count);
+	std::vector<size_t> counts = std::vector<size_t>(levels.size(), 0);
+	for(size_t i = 0; i < count; i++)
+	{
+		uint32_t level = 0;
+		float levelSize = cellSize * 0.5f;
+		const float minLevelSize = radius[i] * 4.0f;
+		while(level < lastLevel && levelSize >= minLevelSize)
+		{
+			levelSize *= 0.5f;
+			level++;
+		}
+		particleLevels[i] = static_cast<uint8_t>(level);
+		//Static particles still count, they are tested against all levels at the resolution of the coarsest one
+		counts[level]++;
+	}
+
+	//Every particle of a finer level is tested against the 3x3 cells around it on all coarser levels,
+	//which only pays off if the finer level holds a lot more particles, otherwise it's merged into the coarser one
+	std::vector<uint32_t> targets = std::vector<uint32_t>(levels.size());
+	for(uint32_t level = 0; level < LevelCount(); level++)
+	{
+		targets[level] = level;
+	}
+	for(uint32_t level = lastLevel; level > 0; level--)
+	{
+		if(counts[level] < counts[level - 1] * minLevelRatio)
+		{
+			counts[level - 1] += counts[level];
+			counts[level] = 0;
+			std::replace(targets.begin(), targets.end(), level, level - 1);
+		}
+	}
+
+	for(std::vector<uint32_t>& particles : levelParticles)
+	{
+		particles.clear();
+	}
+	for(size_t i = 0; i < count; i++)
+	{
+		particleLevels[i] = static_cast<uint8_t>(targets[particleLevels[i]]);
+		if((flags[i] & staticFlags) == 0)
+		{
+			levelParticles[particleLevels[i]].push_back(static_cast<uint32_t>(i));
+		}
+	}
+}
+
+void HierarchicalGrid::Build(const float* posX, const float* posY, ThreadPool& threadPool)
+{
+	if(staticDirty)
+	{
+		BuildStaticLayer(posX, posY, threadPool);
+	}
+
+	if(levels.size() == 1 && staticParticles.empty())
+	{
+		levels[0].Build(posX, posY, particleCount, threadPool);
+		return;
+	}
+
+	for(size_t i = 0; i < levels.size(); i++)
+	{
+		levels[i].Build(posX, posY, levelParticles[i].data(), levelParticles[i].size(), threadPool);
+	}
+}
+
+void HierarchicalGrid::Build(const float* posX, const float* posY, const uint32_t* subset, size_t count, ThreadPool& threadPool)
+{
+	if(staticDirty)
+	{
+		BuildStaticLayer(posX, posY, threadPool);
+	}
+
+	if(levels.size() == 1)
+	{
+		levels[0].Build(posX, posY, subset, count, threadPool);
+		return;
+	}
+
+	for(std::vector<uint32_t>& particles : levelSubsets)
+	{
+		particles.clear();
+	}
+	for(size_t i = 0; i < count; i++)
+	{
+		levelSubsets[particleLevels[subset[i]]].push_back(subset[i]);
+	}
+	for(size_t i = 0; i < levels.size(); i++)
+	{
+		levels[i].Build(posX, posY, levelSubsets[i].data(), levelSubsets[i].size(), threadPool);
+	}
+}
+
+void HierarchicalGrid::BuildStaticLayer(const float* posX, const float* posY, ThreadPool& threadPool)
+{
+	staticLayer.Build(posX, posY, staticParticles.data(), staticParticles.size(), threadPool);
+	staticDirty = false;
+
+	//Static particles are usually few, so most cells can skip the layer without looking into it
+	const int32_t cellsX = staticLayer.CellsX();
+	const int32_t cellsY = staticLayer.CellsY();
+	staticNeighborhood.assign(staticLayer.CellCount(), 0);
+	staticLayer.ForEachCell(0, staticLayer.CellCount(), [&](uint32_t cell, PartitioningCell)
+	{
+		const int32_t x = static_cast<int32_t>(cell) / cellsY;
+		const int32_t y = static_cast<int32_t>(cell) % cellsY;
+		for(int32_t nx = std::max(x - 1, 0); nx < std::min(x + 2, cellsX); nx++)
+		{
+			for(int32_t ny = std::max(y - 1, 0); ny < std::min(y + 2, cellsY); ny++)
+			{
+				staticNeighborhood[nx * cellsY + ny] = 1;
+			}
+		}
+	});
+}
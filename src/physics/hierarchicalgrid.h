@@ -0,0 +1,59 @@
+#pragma once
+#include "partitioning.h"
+#include "structs/vector2.h"
+#include "ecs/threadpool.h"
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+//Stack of partitioning grids, every level halves the cell size of the previous one
+//Particles are binned into the finest level whose cells are at least twice as large as their diameter,
+//so particles only collide with particles of the neighboring cells on their own level and of the coarser levels
+//Static particles never move, they are binned once into a layer with the cells of the coarsest level and never into the levels
+class HierarchicalGrid
+{
+public:
+	HierarchicalGrid(Vector2 min, Vector2 max, float cellSize, uint32_t levelCount);
+	//Coarsest level with exactly these cell counts, particles are assigned to levels by the smaller side of its cells
+	HierarchicalGrid(Vector2 min, Vector2 max, int32_t cellsX, int32_t cellsY, uint32_t levelCount);
+
+	//Has to be called whenever particles were added or moved in storage, particles with any of staticFlags set are static
+	void AssignLevels(const float* radius, const uint8_t* flags, uint8_t staticFlags, size_t count);
+	void Build(const float* posX, const float* posY, ThreadPool& threadPool);
+	//Bins only the listed particles into the levels, which can't be static ones, the static layer stays as it is
+	void Build(const float* posX, const float* posY, const uint32_t* subset, size_t count, ThreadPool& threadPool);
+
+	uint32_t LevelCount() const { return static_cast<uint32_t>(levels.size()); }
+	const PartitioningGrid& Level(uint32_t level) const { return levels[level]; }
+	const PartitioningGrid& StaticLayer() const { return staticLayer; }
+	//Whether the 3x3 cells around a cell of the static layer hold any static particles
+	bool NearStatic(uint32_t cell) const { return staticNeighborhood[cell] != 0; }
+	//Offset of the cells of a level in a cell array spanning all levels
+	uint32_t CellOffset(uint32_t level) const { return cellOffsets[level]; }
+	uint32_t CellCount() const { return cellOffsets.back(); }
+	float CellSize() const { return cellSize; }
+	//Coordinates in the coarsest level
+	std::pair<int32_t, int32_t> CellCoords(Vector2 pos) const { return levels[0].CellCoords(pos); }
+
+private:
+	//A finer level needs this many times the particles of the next coarser level to be kept separate
+	static constexpr size_t minLevelRatio = 4;
+
+	std::vector<PartitioningGrid> levels = {};
+	std::vector<uint32_t> cellOffsets = {};
+	//Particles of each level and the level of each particle, unused with a single level
+	std::vector<std::vector<uint32_t>> levelParticles = {};
+	std::vector<uint8_t> particleLevels = {};
+	//Particles of each level in a subset build
+	std::vector<std::vector<uint32_t>> levelSubsets = {};
+	PartitioningGrid staticLayer;
+	std::vector<uint32_t> staticParticles = {};
+	std::vector<uint8_t> staticNeighborhood = {};
+	//Set when the static particles changed and the layer has to be binned again
+	bool staticDirty = false;
+	float cellSize;
+	size_t particleCount = 0;
+
+	void AddLevels(Vector2 min, Vector2 max, uint32_t levelCount);
+	void BuildStaticLayer(const float* posX, const float* posY, ThreadPool& threadPool);
+};
@@ -0,0 +1,250 @@
+#pragma once
+#include "particlestorage.h"
+#include "utils/cpu.h"
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <bit>
+#include <vector>
+#include <span>
+#include <initializer_list>
+#if CPU_X64
+#include <immintrin.h>
+#endif
+
+//Batched overlap tests for grid cells
+//A cell is packed into lanes once and tested against itself and the particles of its neighbor cells, overlapping pairs are handed to the resolve function
+//Resolving a pair moves the tested particle, so the lanes after it in the batch are tested again from its new position
+//This resolves the same pairs in the same order as testing them one at a time
+namespace NarrowPhase
+{
+	constexpr size_t maxLanes = 8;
+
+	struct PackedCell
+	{
+		std::vector<float> x = {};
+		std::vector<float> y = {};
+		std::vector<float> r = {};
+		const uint32_t* indices = nullptr;
+		size_t count = 0;
+		//Copy of the indices when packing several cells
+		std::vector<uint32_t> gathered = {};
+		//Candidate pairs tested with this cell, for the stats
+		uint64_t tests = 0;
+		//Overlaps of the resolved pairs relative to their radii, measuring how far a collision pass is from converging
+		float maxPenetration = 0.0f;
+		double penetrationSum = 0.0;
+		uint64_t contacts = 0;
+		//Overlaps above the tolerance, these are left for another pass
+		float tolerance = std::numeric_limits<float>::infinity();
+		uint64_t unresolved = 0;
+
+		void AddPenetration(float penetration)
+		{
+			if(penetration > 0.0f)
+			{
+				maxPenetration = std::max(maxPenetration, penetration);
+				penetrationSum += penetration;
+				contacts++;
+				unresolved += penetration > tolerance ? 1 : 0;
+			}
+		}
+
+		void Pack(const ParticleStorage& p, std::initializer_list<std::span<const uint32_t>> cells)
+		{
+			gathered.clear();
+			for(std::span<const uint32_t> cell : cells)
+			{
+				gathered.insert(gathered.end(), cell.begin(), cell.end());
+			}
+			Pack(p, gathered.data(), gathered.size());
+		}
+
+		void Pack(const ParticleStorage& p, const uint32_t* cell, size_t amount)
+		{
+			indices = cell;
+			count = amount;
+			if(x.size() < amount + maxLanes)
+			{
+				x.resize(amount + maxLanes);
+				y.resize(amount + maxLanes);
+				r.resize(amount + maxLanes);
+			}
+			for(size_t i = 0; i < amount; i++)
+			{
+				Refresh(p, i);
+			}
+			//Padding lanes can never overlap
+			for(size_t i = amount; i < amount + maxLanes; i++)
+			{
+				x[i] = std::numeric_limits<float>::infinity();
+				y[i] = std::numeric_limits<float>::infinity();
+				r[i] = 0.0f;
+			}
+		}
+
+		void Refresh(const ParticleStorage& p, size_t i)
+		{
+			const uint32_t index = indices[i];
+			x[i] = p.posX[index];
+			y[i] = p.posY[index];
+			r[i] = p.radius[index];
+		}
+	};
+
+	template<typename Func>
+	inline void TestScalar(const ParticleStorage& p, uint32_t a, PackedCell& b, size_t from, Func& resolve)
+	{
+		float ax = p.posX[a];
+		float ay = p.posY[a];
+		const float ar = p.radius[a];
+		for(size_t j = from; j < b.count; j++)
+		{
+			const float dx = b.x[j] - ax;
+			const float dy = b.y[j] - ay;
+			const float rs = b.r[j] + ar;
+			if(dx * dx + dy * dy < rs * rs)
+			{
+				resolve(a, b.indices[j]);
+				b.Refresh(p, j);
+				ax = p.posX[a];
+				ay = p.posY[a];
+			}
+		}
+	}
+
+#if CPU_X64
+	template<typename Func>
+	inline void TestSSE(const ParticleStorage& p, uint32_t a, PackedCell& b, size_t from, Func& resolve)
+	{
+		__m128 ax = _mm_set1_ps(p.posX[a]);
+		__m128 ay = _mm_set1_ps(p.posY[a]);
+		const __m128 ar = _mm_set1_ps(p.radius[a]);
+		for(size_t j = from; j < b.count; j += 4)
+		{
+			const __m128 dx = _mm_sub_ps(_mm_loadu_ps(&b.x[j]), ax);
+			const __m128 dy = _mm_sub_ps(_mm_loadu_ps(&b.y[j]), ay);
+			const __m128 rs = _mm_add_ps(_mm_loadu_ps(&b.r[j]), ar);
+			const __m128 sqrDst = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+			uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(sqrDst, _mm_mul_ps(rs, rs))));
+			while(mask != 0)
+			{
+				const uint32_t lane = std::countr_zero(mask);
+				resolve(a, b.indices[j + lane]);
+				b.Refresh(p, j + lane);
+				ax = _mm_set1_ps(p.posX[a]);
+				ay = _mm_set1_ps(p.posY[a]);
+
+				//Lanes after the resolved one may only overlap from the new position, or not anymore
+				const __m128 ndx = _mm_sub_ps(_mm_loadu_ps(&b.x[j]), ax);
+				const __m128 ndy = _mm_sub_ps(_mm_loadu_ps(&b.y[j]), ay);
+				const __m128 nSqrDst = _mm_add_ps(_mm_mul_ps(ndx, ndx), _mm_mul_ps(ndy, ndy));
+				mask = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(nSqrDst, _mm_mul_ps(rs, rs)))) & (~0u << (lane + 1));
+			}
+		}
+	}
+
+	template<typename Func>
+	CPU_TARGET_AVX2 inline void TestAVX2(const ParticleStorage& p, uint32_t a, PackedCell& b, size_t from, Func& resolve)
+	{
+		__m256 ax = _mm256_set1_ps(p.posX[a]);
+		__m256 ay = _mm256_set1_ps(p.posY[a]);
+		const __m256 ar = _mm256_set1_ps(p.radius[a]);
+		for(size_t j = from; j < b.count; j += 8)
+		{
+			const __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&b.x[j]), ax);
+			const __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&b.y[j]), ay);
+			const __m256 rs = _mm256_add_ps(_mm256_loadu_ps(&b.r[j]), ar);
+			const __m256 sqrDst = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+			uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(sqrDst, _mm256_mul_ps(rs, rs), _CMP_LT_OQ)));
+			while(mask != 0)
+			{
+				const uint32_t lane = std::countr_zero(mask);
+				resolve(a, b.indices[j + lane]);
+				b.Refresh(p, j + lane);
+				ax = _mm256_set1_ps(p.posX[a]);
+				ay = _mm256_set1_ps(p.posY[a]);
+
+				const __m256 ndx = _mm256_sub_ps(_mm256_loadu_ps(&b.x[j]), ax);
+				const __m256 ndy = _mm256_sub_ps(_mm256_loadu_ps(&b.y[j]), ay);
+				const __m256 nSqrDst = _mm256_add_ps(_mm256_mul_ps(ndx, ndx), _mm256_mul_ps(ndy, ndy));
+				mask = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(nSqrDst, _mm256_mul_ps(rs, rs), _CMP_LT_OQ))) & (~0u << (lane + 1));
+			}
+		}
+	}
+#endif
+
+	template<SimdLevel L, typename Func>
+	inline void Test(const ParticleStorage& p, uint32_t a, PackedCell& b, size_t from, Func& resolve)
+	{
+#if CPU_X64
+		if constexpr(L == SimdLevel::AVX2)
+		{
+			TestAVX2(p, a, b, from, resolve);
+			return;
+		}
+		else if constexpr(L == SimdLevel::SSE)
+		{
+			TestSSE(p, a, b, from, resolve);
+			return;
+		}
+#endif
+		TestScalar(p, a, b, from, resolve);
+	}
+
+	//Tests all pairs within the packed cell
+	template<SimdLevel L, typename Func>
+	void SolveCell(const ParticleStorage& p, PackedCell& packed, Func& resolve)
+	{
+		for(size_t i = 0; i < packed.count; i++)
+		{
+			Test<L>(p, packed.indices[i], packed, i + 1, resolve);
+			//The particle may have been pushed while testing it against the rest of the cell
+			packed.Refresh(p, i);
+		}
+	}
+
+	//Tests all pairs between the particles of a cell and the packed cell
+	template<SimdLevel L, typename Func>
+	void SolveCells(const ParticleStorage& p, const uint32_t* cell, size_t count, PackedCell& packed, Func& resolve)
+	{
+		for(size_t i = 0; i < count; i++)
+		{
+			Test<L>(p, cell[i], packed, 0, resolve);
+		}
+	}
+
+	template<typename Func>
+	void SolveCell(SimdLevel level, const ParticleStorage& p, PackedCell& packed, Func&& resolve)
+	{
+		switch(level)
+		{
+			case SimdLevel::AVX2:
+				SolveCell<SimdLevel::AVX2>(p, packed, resolve);
+				break;
+			case SimdLevel::SSE:
+				SolveCell<SimdLevel::SSE>(p, packed, resolve);
+				break;
+			default:
+				SolveCell<SimdLevel::Scalar>(p, packed, resolve);
+				break;
+		}
+	}
+
+	template<typename Func>
+	void SolveCells(SimdLevel level, const ParticleStorage& p, const uint32_t* cell, size_t count, PackedCell& packed, Func&& resolve)
+	{
+		switch(level)
+		{
+			case SimdLevel::AVX2:
+				SolveCells<SimdLevel::AVX2>(p, cell, count, packed, resolve);
+				break;
+			case SimdLevel::SSE:
+				SolveCells<SimdLevel::SSE>(p, cell, count, packed, resolve);
+				break;
+			default:
+				SolveCells<SimdLevel::Scalar>(p, cell, count, packed, resolve);
+				break;
+		}
+	}
+}
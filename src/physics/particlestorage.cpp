@@ -0,0 +1,85 @@
+#include "particlestorage.h"
+
+template<typename T, typename Func>
+static void AppendRange(std::vector<T>& vec, size_t count, Func&& valueFunc)
+{
+	vec.reserve(vec.size() + count);
+	for(size_t i = 0; i < count; i++)
+	{
+		vec.push_back(valueFunc(i));
+	}
+}
+
+void ParticleStorage::Append(const Entity* e, const Transform* t, const Particle* p, size_t count)
+{
+	const size_t index = Size();
+	AppendRange(posX, count, [&](size_t i) { return t[i].Position().x; });
+	AppendRange(posY, count, [&](size_t i) { return t[i].Position().y; });
+	AppendRange(prevX, count, [&](size_t i) { return p[i].prevPos.x; });
+	AppendRange(prevY, count, [&](size_t i) { return p[i].prevPos.y; });
+	AppendRange(accX, count, [&](size_t i) { return p[i].acc.x; });
+	AppendRange(accY, count, [&](size_t i) { return p[i].acc.y; });
+	AppendRange(radius, count, [&](size_t i) { return p[i].radius; });
+	AppendRange(invMass, count, [&](size_t i) { return p[i].pinned || p[i].mass <= 0.0f ? 0.0f : 1.0f / p[i].mass; });
+	AppendRange(bounciness, count, [&](size_t i) { return p[i].bounciness; });
+	AppendRange(flags, count, [&](size_t i) { return static_cast<uint8_t>(p[i].pinned ? ParticleFlags::Pinned : ParticleFlags::None); });
+	AppendRange(restTime, count, [&](size_t i) { return 0.0f; });
+	AppendRange(restX, count, [&](size_t i) { return t[i].Position().x; });
+	AppendRange(restY, count, [&](size_t i) { return t[i].Position().y; });
+	AppendRange(pressTime, count, [&](size_t i) { return 0.0f; });
+	AppendRange(rateShift, count, [&](size_t i) { return static_cast<uint8_t>(0); });
+	AppendRange(entities, count, [&](size_t i) { return e[i]; });
+
+	for(size_t i = index; i < entities.size(); i++)
+	{
+		entityIndices[entities[i]] = static_cast<uint32_t>(i);
+	}
+	version++;
+}
+
+template<typename T>
+static void ReorderVector(std::vector<T>& vec, const std::vector<uint32_t>& order)
+{
+	std::vector<T> reordered = std::vector<T>(vec.size());
+	for(size_t i = 0; i < order.size(); i++)
+	{
+		reordered[i] = vec[order[i]];
+	}
+	vec = std::move(reordered);
+}
+
+void ParticleStorage::Reorder(const std::vector<uint32_t>& order)
+{
+	ReorderVector(posX, order);
+	ReorderVector(posY, order);
+	ReorderVector(prevX, order);
+	ReorderVector(prevY, order);
+	ReorderVector(accX, order);
+	ReorderVector(accY, order);
+	ReorderVector(radius, order);
+	ReorderVector(invMass, order);
+	ReorderVector(bounciness, order);
+	ReorderVector(flags, order);
+	ReorderVector(restTime, order);
+	ReorderVector(restX, order);
+	ReorderVector(restY, order);
+	ReorderVector(pressTime, order);
+	ReorderVector(rateShift, order);
+	ReorderVector(entities, order);
+
+	for(size_t i = 0; i < entities.size(); i++)
+	{
+		entityIndices[entities[i]] = static_cast<uint32_t>(i);
+	}
+	version++;
+}
+
+std::optional<uint32_t> ParticleStorage::IndexOf(Entity entity) const
+{
+	auto it = entityIndices.find(entity);
+	if(it != entityIndices.end())
+	{
+		return it->second;
+	}
+	return std::nullopt;
+}
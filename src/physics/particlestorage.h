@@ -0,0 +1,93 @@
+#pragma once
+#include "simulation/components.h"
+#include "ecs/entity.h"
+#include "structs/vector2.h"
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+
+enum class ParticleFlags : uint8_t
+{
+	None = 0,
+	Pinned = 1 << 0,
+	//Skips integration until woken up
+	Sleeping = 1 << 1,
+	//Moved fast enough in the last substep to wake sleeping particles around it
+	Moving = 1 << 2,
+	//Skips the running substep, because its cell runs at a lower substep rate
+	Waiting = 1 << 3,
+	//Sleeping and pushed into by an awake particle in the running substep
+	Pressed = 1 << 4
+};
+
+//Hot particle state owned by the solver in structure of arrays layout
+//Indices are stable until the storage is reordered, new particles are appended at the end
+class ParticleStorage
+{
+public:
+	std::vector<float> posX = {};
+	std::vector<float> posY = {};
+	std::vector<float> prevX = {};
+	std::vector<float> prevY = {};
+	std::vector<float> accX = {};
+	std::vector<float> accY = {};
+	std::vector<float> radius = {};
+	//0 for pinned particles
+	std::vector<float> invMass = {};
+	std::vector<float> bounciness = {};
+	std::vector<uint8_t> flags = {};
+	//Time the particle has stayed close to the rest position (restX, restY)
+	std::vector<float> restTime = {};
+	std::vector<float> restX = {};
+	std::vector<float> restY = {};
+	//Time a sleeping particle has been pushed into by awake particles, it runs back down while nothing pushes
+	std::vector<float> pressTime = {};
+	//The particle takes one substep out of every 2^rateShift in multi rate mode, its velocity is the distance moved in such a step
+	std::vector<uint8_t> rateShift = {};
+	std::vector<Entity> entities = {};
+
+	size_t Size() const { return posX.size(); }
+	//Changes whenever particles are appended or reordered
+	uint32_t Version() const { return version; }
+
+	Vector2 Position(size_t index) const { return Vector2(posX[index], posY[index]); }
+	Vector2 PrevPosition(size_t index) const { return Vector2(prevX[index], prevY[index]); }
+	bool HasFlag(size_t index, ParticleFlags flag) const { return (flags[index] & static_cast<uint8_t>(flag)) != 0; }
+	void SetFlag(size_t index, ParticleFlags flag) { flags[index] |= static_cast<uint8_t>(flag); }
+	void ClearFlag(size_t index, ParticleFlags flag) { flags[index] &= ~static_cast<uint8_t>(flag); }
+	//Pinned, sleeping and waiting particles don't move on their own
+	bool IsResting(size_t index) const { return (flags[index] & (static_cast<uint8_t>(ParticleFlags::Pinned) | static_cast<uint8_t>(ParticleFlags::Sleeping) | static_cast<uint8_t>(ParticleFlags::Waiting))) != 0; }
+
+	//A correction turns into velocity over the stride of the particle, scaling by the stride gives both sides of a pair the same impulse
+	float EffectiveInvMass(size_t index) const { return HasFlag(index, ParticleFlags::Sleeping) ? 0.0f : invMass[index] * static_cast<float>(1u << rateShift[index]); }
+
+	void Wake(size_t index)
+	{
+		ClearFlag(index, ParticleFlags::Sleeping);
+		ClearFlag(index, ParticleFlags::Pressed);
+		restTime[index] = 0.0f;
+		pressTime[index] = 0.0f;
+	}
+
+	void SetPosition(size_t index, Vector2 pos)
+	{
+		posX[index] = pos.x;
+		posY[index] = pos.y;
+	}
+
+	void SetPrevPosition(size_t index, Vector2 pos)
+	{
+		prevX[index] = pos.x;
+		prevY[index] = pos.y;
+	}
+
+	void Append(const Entity* e, const Transform* t, const Particle* p, size_t count);
+	//Moves the particle at order[i] to index i
+	void Reorder(const std::vector<uint32_t>& order);
+	std::optional<uint32_t> IndexOf(Entity entity) const;
+
+private:
+	std::unordered_map<Entity, uint32_t> entityIndices = {};
+	uint32_t version = 0;
+};
@@ -0,0 +1,171 @@
+#include "partitioning.h"
+#include <bit>
+
+//Index of the i-th binned particle
+static inline uint32_t SubsetIndex(const uint32_t* subset, size_t i)
+{
+	return subset != nullptr ? subset[i] : static_cast<uint32_t>(i);
+}
+
+void PartitioningGrid::Build(const float* posX, const float* posY, size_t count, ThreadPool& threadPool)
+{
+	Build(posX, posY, nullptr, count, threadPool);
+}
+
+void PartitioningGrid::Build(const float* posX, const float* posY, const uint32_t* subset, size_t count, ThreadPool& threadPool)
+{
+	//Nothing was binned by the last build either, all cells are still empty
+	if(count == 0 && indices.empty())
+	{
+		return;
+	}
+
+	ClearCells();
+	particleCells.resize(count);
+	indices.resize(count);
+	slotCells.resize(count);
+	if(count < parallelBuildThreshold || threadPool.ThreadCount() <= 1)
+	{
+		BuildSerial(posX, posY, subset, count);
+	}
+	else
+	{
+		BuildParallel(posX, posY, subset, count, threadPool);
+	}
+}
+
+void PartitioningGrid::ClearCells()
+{
+	//Only cells occupied by the last build can be non zero
+	for(uint32_t cell : slotCells)
+	{
+		cellStart[cell] = 0;
+		cellCount[cell] = 0;
+	}
+}
+
+void PartitioningGrid::BuildSerial(const float* posX, const float* posY, const uint32_t* subset, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		const uint32_t p = SubsetIndex(subset, i);
+		uint32_t cell = CellIndex(Vector2(posX[p], posY[p]));
+		particleCells[i] = cell;
+		cellCount[cell]++;
+		occupied[cell / 64] |= uint64_t(1) << (cell % 64);
+	}
+
+	//Offsets in ascending cell order, skipping empty cells 64 at a time
+	uint32_t offset = 0;
+	for(size_t w = 0; w < occupied.size(); w++)
+	{
+		uint64_t bits = occupied[w];
+		occupied[w] = 0;
+		while(bits != 0)
+		{
+			const uint32_t cell = static_cast<uint32_t>(w * 64 + std::countr_zero(bits));
+			bits &= bits - 1;
+			cellStart[cell] = offset;
+			cellFill[cell] = offset;
+			offset += cellCount[cell];
+		}
+	}
+
+	for(size_t i = 0; i < count; i++)
+	{
+		const uint32_t cell = particleCells[i];
+		const uint32_t slot = cellFill[cell]++;
+		indices[slot] = SubsetIndex(subset, i);
+		slotCells[slot] = cell;
+	}
+}
+
+void PartitioningGrid::BuildParallel(const float* posX, const float* posY, const uint32_t* subset, size_t count, ThreadPool& threadPool)
+{
+	const size_t threads = threadPool.ThreadCount();
+	const size_t cells = CellCount();
+	const std::vector<std::pair<size_t, size_t>> particleRanges = ThreadPool::SplitWork(count, threads);
+	const std::vector<std::pair<size_t, size_t>> cellRanges = ThreadPool::SplitWork(cells, threads);
+	threadCounts.resize(threads);
+	rangeSums.resize(threads);
+
+	//Histogram per thread over a contiguous range of particles
+	for(size_t t = 0; t < threads; t++)
+	{
+		threadPool.EnqueueJob([this, t, posX, posY, subset, cells, range = particleRanges[t]]
+		{
+			std::vector<uint32_t>& counts = threadCounts[t];
+			counts.assign(cells, 0);
+			for(size_t i = range.first; i < range.first + range.second; i++)
+			{
+				const uint32_t p = SubsetIndex(subset, i);
+				uint32_t cell = CellIndex(Vector2(posX[p], posY[p]));
+				particleCells[i] = cell;
+				counts[cell]++;
+			}
+		});
+	}
+	threadPool.WaitForCompletion();
+
+	//Turn the counts into offsets inside of each cell, particles of earlier threads come first
+	for(size_t r = 0; r < threads; r++)
+	{
+		threadPool.EnqueueJob([this, r, threads, range = cellRanges[r]]
+		{
+			uint32_t sum = 0;
+			for(size_t c = range.first; c < range.first + range.second; c++)
+			{
+				uint32_t cellSum = 0;
+				for(size_t t = 0; t < threads; t++)
+				{
+					uint32_t n = threadCounts[t][c];
+					threadCounts[t][c] = cellSum;
+					cellSum += n;
+				}
+				cellCount[c] = cellSum;
+				sum += cellSum;
+			}
+			rangeSums[r] = sum;
+		});
+	}
+	threadPool.WaitForCompletion();
+
+	//Prefix sum over the cells, the sums of the ranges are scanned serially first
+	uint32_t rangeOffset = 0;
+	for(size_t r = 0; r < threads; r++)
+	{
+		uint32_t sum = rangeSums[r];
+		rangeSums[r] = rangeOffset;
+		rangeOffset += sum;
+	}
+	for(size_t r = 0; r < threads; r++)
+	{
+		threadPool.EnqueueJob([this, r, range = cellRanges[r]]
+		{
+			uint32_t offset = rangeSums[r];
+			for(size_t c = range.first; c < range.first + range.second; c++)
+			{
+				cellStart[c] = cellCount[c] != 0 ? offset : 0;
+				offset += cellCount[c];
+			}
+		});
+	}
+	threadPool.WaitForCompletion();
+
+	//Scatter, every thread writes to its own slots so the result equals the serial build
+	for(size_t t = 0; t < threads; t++)
+	{
+		threadPool.EnqueueJob([this, t, subset, range = particleRanges[t]]
+		{
+			std::vector<uint32_t>& offsets = threadCounts[t];
+			for(size_t i = range.first; i < range.first + range.second; i++)
+			{
+				uint32_t cell = particleCells[i];
+				const uint32_t slot = cellStart[cell] + offsets[cell]++;
+				indices[slot] = SubsetIndex(subset, i);
+				slotCells[slot] = cell;
+			}
+		});
+	}
+	threadPool.WaitForCompletion();
+}
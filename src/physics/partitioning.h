@@ -1,69 +1,119 @@
 #pragma once
-#include "simulation/components.h"
+#include "structs/vector2.h"
+#include "ecs/threadpool.h"
 #include <cstdint>
 #include <cmath>
 #include <vector>
+#include <span>
+#include <utility>
 #include <algorithm>
 
-struct PartitioningCellEntry
-{
-	Transform* t;
-	Particle* p;
-
-	PartitioningCellEntry(Transform* t, Particle* p) : t(t), p(p) { }
-	PartitioningCellEntry() : t(nullptr), p(nullptr) { }
-};
-
-using PartitioningCell = std::vector<PartitioningCellEntry>;
+//Indices into the particle storage of the solver
+using PartitioningCell = std::span<const uint32_t>;
 
+//Flat uniform grid built with a counting sort
+//All cells share one index array sorted by cell, cell c owns the range [cellStart[c], cellStart[c] + cellCount[c]) of it
+//Serial builds only touch occupied cells, so fine grids with mostly empty cells stay cheap
 class PartitioningGrid
 {
 public:
-	PartitioningGrid(Vector2 min, Vector2 max, float cellSize) : bMin(min), bMax(max), bSize(max - min), cellSize(cellSize)
+	PartitioningGrid(Vector2 min, Vector2 max, float cellSize)
+		: PartitioningGrid(min, max, static_cast<int32_t>(std::ceilf((max - min).x / cellSize)), static_cast<int32_t>(std::ceilf((max - min).y / cellSize)))
+	{
+
+	}
+
+	PartitioningGrid(Vector2 min, Vector2 max, int32_t cellsX, int32_t cellsY) : bMin(min), bMax(max), bSize(max - min), cellsX(cellsX), cellsY(cellsY)
 	{
-		cellsX = static_cast<int32_t>(std::ceilf(bSize.x / cellSize));
-		cellsY = static_cast<int32_t>(std::ceilf(bSize.y / cellSize));
 		lastXCell = cellsX - 1;
 		lastYCell = cellsY - 1;
-		cells = std::vector<PartitioningCell>(cellsX * cellsY);
-		for(PartitioningCell& cell : cells)
-		{
-			cell.reserve(16);
-		}
+		cellStart = std::vector<uint32_t>(CellCount(), 0);
+		cellCount = std::vector<uint32_t>(CellCount(), 0);
+		cellFill = std::vector<uint32_t>(CellCount(), 0);
+		occupied = std::vector<uint64_t>((CellCount() + 63) / 64, 0);
 	}
 
-	void Clear()
+	//Bins positions [0, count) into the grid, indices keep their relative order inside of each cell
+	void Build(const float* posX, const float* posY, size_t count, ThreadPool& threadPool);
+	//Bins only the particles listed in subset
+	void Build(const float* posX, const float* posY, const uint32_t* subset, size_t count, ThreadPool& threadPool);
+
+	PartitioningCell At(int32_t x, int32_t y) const
 	{
-		for(PartitioningCell& cell : cells)
-		{
-			cell.clear();
-		}
+		return At(static_cast<uint32_t>(x * cellsY + y));
 	}
 
-	PartitioningCell& At(int32_t x, int32_t y)
+	PartitioningCell At(uint32_t cell) const
 	{
-		return cells[x * cellsY + y];
+		return PartitioningCell(indices.data() + cellStart[cell], cellCount[cell]);
 	}
 
-	void Insert(Transform* t, Particle* p)
+	//Particles of all cells in [beginCell, endCell), they are stored next to each other
+	PartitioningCell Range(uint32_t beginCell, uint32_t endCell) const
+	{
+		auto begin = std::lower_bound(slotCells.begin(), slotCells.end(), beginCell);
+		auto end = std::lower_bound(begin, slotCells.end(), endCell);
+		return PartitioningCell(indices.data() + (begin - slotCells.begin()), end - begin);
+	}
+
+	//Calls func(cell, particles) for every occupied cell in [beginCell, endCell) in ascending order
+	template<typename Func>
+	void ForEachCell(uint32_t beginCell, uint32_t endCell, Func&& func) const
+	{
+		size_t slot = std::lower_bound(slotCells.begin(), slotCells.end(), beginCell) - slotCells.begin();
+		while(slot < slotCells.size() && slotCells[slot] < endCell)
+		{
+			const uint32_t cell = slotCells[slot];
+			func(cell, At(cell));
+			slot += cellCount[cell];
+		}
+	}
+
+	std::pair<int32_t, int32_t> CellCoords(Vector2 pos) const
 	{
-		Vector2& pos = t->Position();
 		int32_t cx = static_cast<int32_t>((pos.x - bMin.x) / bSize.x * static_cast<float>(cellsX));
 		int32_t cy = static_cast<int32_t>((pos.y - bMin.y) / bSize.y * static_cast<float>(cellsY));
-		cells[std::clamp(cx, 0, lastXCell) * cellsY + std::clamp(cy, 0, lastYCell)].push_back(PartitioningCellEntry(t, p));
+		return std::make_pair(std::clamp(cx, 0, lastXCell), std::clamp(cy, 0, lastYCell));
+	}
+
+	uint32_t CellIndex(Vector2 pos) const
+	{
+		auto [cx, cy] = CellCoords(pos);
+		return static_cast<uint32_t>(cx * cellsY + cy);
 	}
 
+	//Amount of particles binned by the last build
+	size_t Size() const { return indices.size(); }
 	int32_t CellsX() const { return cellsX; }
 	int32_t CellsY() const { return cellsY; }
+	uint32_t CellCount() const { return static_cast<uint32_t>(cellsX * cellsY); }
 
 private:
-	std::vector<PartitioningCell> cells;
-	const Vector2 bMin;
-	const Vector2 bMax;
-	const Vector2 bSize;
-	const float cellSize;
+	//Below this amount of particles the serial build is faster than the parallel one
+	static const size_t parallelBuildThreshold = 8192;
+
+	//Start and count are 0 for empty cells
+	std::vector<uint32_t> cellStart = {};
+	std::vector<uint32_t> cellCount = {};
+	std::vector<uint32_t> cellFill = {};
+	//Bitmask of the cells occupied in the serial build, cleared again while computing the offsets
+	std::vector<uint64_t> occupied = {};
+	//Per thread cell counts in the parallel build, reused as scatter offsets afterwards
+	std::vector<std::vector<uint32_t>> threadCounts = {};
+	std::vector<uint32_t> rangeSums = {};
+	std::vector<uint32_t> indices = {};
+	//Cell of each entry in indices
+	std::vector<uint32_t> slotCells = {};
+	std::vector<uint32_t> particleCells = {};
+	Vector2 bMin;
+	Vector2 bMax;
+	Vector2 bSize;
 	int32_t cellsX;
 	int32_t cellsY;
 	int32_t lastXCell;
 	int32_t lastYCell;
+
+	void ClearCells();
+	void BuildSerial(const float* posX, const float* posY, const uint32_t* subset, size_t count);
+	void BuildParallel(const float* posX, const float* posY, const uint32_t* subset, size_t count, ThreadPool& threadPool);
 };
@@ -0,0 +1,142 @@
+#include "partitioningtuner.h"
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+PartitioningTuner::PartitioningTuner(float cellSize) : cellSize(cellSize)
+{
+
+}
+
+void PartitioningTuner::AddRadii(const float* radius, size_t count)
+{
+	for(size_t i = 0; i < count; i++)
+	{
+		const float r = radius[i];
+		minRadius = particleCount == 0 ? r : std::fminf(minRadius, r);
+		maxRadius = std::fmaxf(maxRadius, r);
+		const int32_t bin = static_cast<int32_t>(std::floorf(std::log2f(std::fmaxf(r, 1e-6f)))) + histogramOffset;
+		histogram[std::clamp(bin, 0, static_cast<int32_t>(histogramBins) - 1)]++;
+		particleCount++;
+	}
+}
+
+std::optional<float> PartitioningTuner::Fit()
+{
+	if(cellSize >= MinCellSize())
+	{
+		return std::nullopt;
+	}
+
+	//Particles larger than the cells would miss collisions, so this can't wait for the current round to finish
+	//A fresh round starts from there once enough particles exist
+	trial = std::nullopt;
+	cellSize = MinCellSize() * 2.0f;
+	tunedParticleCount = 0;
+	return cellSize;
+}
+
+std::optional<float> PartitioningTuner::Update(double collisionTime, uint32_t substeps, size_t particles, uint64_t pairTests)
+{
+	const float lastSize = cellSize;
+	if(!trial)
+	{
+		if(DistributionChanged())
+		{
+			StartTrial();
+		}
+	}
+	else if(substeps > 0 && particles > 0)
+	{
+		Trial& t = trial.value();
+		if(++t.frames > warmupFrames)
+		{
+			t.time += collisionTime;
+			t.work += static_cast<double>(substeps) * static_cast<double>(particles);
+			t.pairTests += pairTests;
+		}
+		if(t.frames >= warmupFrames + trialFrames)
+		{
+			t.results.push_back({ cellSize, t.time / t.work * 1e9, static_cast<double>(t.pairTests) / t.work });
+			NextCandidate();
+		}
+	}
+
+	return cellSize != lastSize ? std::optional<float>(cellSize) : std::nullopt;
+}
+
+uint32_t PartitioningTuner::LevelCount(float size) const
+{
+	if(minRadius <= 0.0f)
+	{
+		return 1;
+	}
+	const float levels = std::floorf(std::log2f(size / (minRadius * 4.0f))) + 1.0f;
+	return static_cast<uint32_t>(std::clamp(levels, 1.0f, static_cast<float>(maxLevels)));
+}
+
+bool PartitioningTuner::DistributionChanged() const
+{
+	if(particleCount < minParticles)
+	{
+		return false;
+	}
+	if(tunedParticleCount == 0 || particleCount >= tunedParticleCount * 2)
+	{
+		return true;
+	}
+
+	float difference = 0.0f;
+	for(size_t i = 0; i < histogramBins; i++)
+	{
+		const float share = static_cast<float>(histogram[i]) / static_cast<float>(particleCount);
+		const float tunedShare = static_cast<float>(tunedHistogram[i]) / static_cast<float>(tunedParticleCount);
+		difference += std::fabs(share - tunedShare);
+	}
+	return difference * 0.5f > histogramChange;
+}
+
+void PartitioningTuner::StartTrial()
+{
+	tunedHistogram = histogram;
+	tunedParticleCount = particleCount;
+
+	//The current size competes as well, so a round never ends up slower than before
+	Trial t = {};
+	for(float scale : candidateScales)
+	{
+		t.sizes.push_back(MinCellSize() * scale);
+	}
+	t.sizes.push_back(cellSize);
+	std::sort(t.sizes.begin(), t.sizes.end());
+	t.sizes.erase(std::unique(t.sizes.begin(), t.sizes.end()), t.sizes.end());
+	t.startCandidate = std::find(t.sizes.begin(), t.sizes.end(), cellSize) - t.sizes.begin();
+
+	trial = std::move(t);
+	cellSize = trial->sizes[0];
+}
+
+void PartitioningTuner::NextCandidate()
+{
+	Trial& t = trial.value();
+	t.frames = 0;
+	t.time = 0.0;
+	t.work = 0.0;
+	t.pairTests = 0;
+
+	//Particles spawned during the round can make the remaining small candidates invalid
+	while(t.results.size() < t.sizes.size() && t.sizes[t.results.size()] < MinCellSize())
+	{
+		t.results.push_back({ t.sizes[t.results.size()], std::numeric_limits<double>::infinity(), 0.0 });
+	}
+	if(t.results.size() < t.sizes.size())
+	{
+		cellSize = t.sizes[t.results.size()];
+		return;
+	}
+
+	previous = t.results[t.startCandidate];
+	chosen = *std::min_element(t.results.begin(), t.results.end(), [](const Result& a, const Result& b) { return a.cost < b.cost; });
+	cellSize = chosen.cellSize;
+	trial = std::nullopt;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <optional>
+
+//Picks the partitioning cell size by timing the collision phases with a few candidate sizes
+//A new round of trials starts whenever the radius distribution or the amount of particles changed noticeably
+class PartitioningTuner
+{
+public:
+	PartitioningTuner(float cellSize);
+
+	void AddRadii(const float* radius, size_t count);
+	//Returns a new cell size when the largest particle no longer fits into the current one, independent of tuning
+	std::optional<float> Fit();
+	//Feeds the collision time and pair tests of a rendered frame, returns a new cell size when the grid has to be rebuilt
+	std::optional<float> Update(double collisionTime, uint32_t substeps, size_t particles, uint64_t pairTests);
+
+	float CellSize() const { return cellSize; }
+	//Every particle has to fit into a cell of the coarsest level
+	float MinCellSize() const { return maxRadius * 2.0f; }
+	float MinRadius() const { return minRadius; }
+	//Levels needed for the finest cells to be twice the diameter of the smallest particles
+	uint32_t LevelCount(float size) const;
+	bool Tuning() const { return trial.has_value(); }
+	//Results of the last round, cost is the collision time in microseconds per 1000 particles and substep
+	float PreviousCellSize() const { return previous.cellSize; }
+	double PreviousCost() const { return previous.cost; }
+	double PreviousPairTests() const { return previous.pairTests; }
+	double Cost() const { return chosen.cost; }
+	double PairTests() const { return chosen.pairTests; }
+
+private:
+	static constexpr size_t histogramBins = 16;
+	//Radii from 2^-histogramOffset upwards get their own bin
+	static constexpr int32_t histogramOffset = 4;
+	static constexpr uint32_t maxLevels = 8;
+	//Frames timed per candidate, the first ones after rebuilding the grid are skipped
+	static constexpr uint32_t trialFrames = 20;
+	static constexpr uint32_t warmupFrames = 2;
+	static constexpr size_t minParticles = 1000;
+	//Share of particles that have to be in other radius bins than at the last round to start a new one
+	static constexpr float histogramChange = 0.25f;
+	static constexpr std::array<float, 4> candidateScales = { 1.0f, 1.5f, 2.0f, 3.0f };
+
+	struct Result
+	{
+		float cellSize = 0.0f;
+		double cost = 0.0;
+		//Per particle and substep
+		double pairTests = 0.0;
+	};
+
+	struct Trial
+	{
+		std::vector<float> sizes = {};
+		std::vector<Result> results = {};
+		//Candidate equal to the cell size before the round
+		size_t startCandidate = 0;
+		uint32_t frames = 0;
+		double time = 0.0;
+		double work = 0.0;
+		uint64_t pairTests = 0;
+	};
+
+	float cellSize;
+	float minRadius = 0.0f;
+	float maxRadius = 0.0f;
+	std::array<size_t, histogramBins> histogram = {};
+	std::array<size_t, histogramBins> tunedHistogram = {};
+	size_t particleCount = 0;
+	size_t tunedParticleCount = 0;
+	std::optional<Trial> trial = std::nullopt;
+	Result previous = {};
+	Result chosen = {};
+
+	bool DistributionChanged() const;
+	void StartTrial();
+	void NextCandidate();
+};
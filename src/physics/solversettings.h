@@ -18,15 +18,81 @@ enum class SolverUpdateMode
 	FixedFrameRate
 };
 
+enum class SolverCollisionMode
+{
+	/// <summary>
+	/// Overlapping pairs are resolved in place one after another, converges fast but the result depends on the order of pairs
+	/// </summary>
+	GaussSeidel,
+	/// <summary>
+	/// Corrections of all pairs are accumulated per particle and applied at once, the result is independent of the thread count
+	/// </summary>
+	Jacobi
+};
+
 struct SolverSettings
 {
 	SolverUpdateMode updateMode = SolverUpdateMode::FixedFrameRate;
 	float timestep = 1.0f / 60.0f;
 	uint32_t substeps = 8;
+	//Picks the substeps of every step between minSubsteps and maxSubsteps, so the fastest particle
+	//only moves a fraction of the smallest radius per substep
+	bool adaptiveSubsteps = false;
+	uint32_t minSubsteps = 2;
+	uint32_t maxSubsteps = 16;
+	//Gives every cell of the coarsest grid level its own substep rate from the speed of its particles, with collisions enabled
+	//Calm cells only take every 2nd, 4th, ... substep up to maxSubstepStride, cells next to faster ones run at least at half their rate
+	bool multiRateSubsteps = false;
+	uint32_t maxSubstepStride = 2;
 
 	Vector2 gravity = Vector2(0.0f, -900.0f);
 	float partitioningSize = 25.0f;
+	//Amount of grid levels starting at partitioningSize, each further level halves the cell size for smaller particles
+	uint32_t partitioningLevels = 1;
+	//Retunes the cell size and levels while running whenever the particle sizes or amount change a lot
+	//The cell size grows to fit the largest particle either way
+	bool autoPartitioning = false;
 	bool collision = true;
+	SolverCollisionMode collisionMode = SolverCollisionMode::GaussSeidel;
+	//Scales the averaged corrections in Jacobi mode, above 1 speeds up convergence
+	float relaxation = 1.0f;
+	//Repeats the collision pass of a substep up to maxIterations times until the deepest overlap a pass finds
+	//is below overlapTolerance, relative to the radii of the overlapping pair
+	bool adaptiveIterations = false;
+	uint32_t maxIterations = 4;
+	float overlapTolerance = 0.02f;
+	//Collects pairs closer than their radii plus neighborSkin once and reuses them over the following substeps,
+	//the lists are rebuilt as soon as any particle moved more than half the skin, they are built over as many levels as the grid
+	bool neighborLists = false;
+	float neighborSkin = 2.0f;
+	//Runs up to blockSubsteps substeps at once, tile by tile, so a tile stays in cache over all of them
+	//Only with neighbor lists in Gauss-Seidel mode and without links, sleeping, multi rate substeps, continuous collision or adaptive iterations
+	//Scenes small enough to stay in cache as a whole, below about 16k particles, always run one substep at a time
+	//A block is undone and run one substep at a time as soon as a particle leaves the skin of the lists before it's done
+	bool temporalBlocking = false;
+	uint32_t blockSubsteps = 4;
+	//Particles moving further than ccdThreshold times their radius in a substep are swept from their previous position
+	//against the other particles and the colliders and stopped at the first contact, so fewer substeps are needed for fast particles
+	bool continuousCollision = false;
+	float ccdThreshold = 0.5f;
+	//Rendered frames between sorting particle storage along a z-order curve over the grid cells, 0 disables it
+	uint32_t reorderInterval = 60;
+
+	//Particles slower than sleepVelocity for sleepTime seconds stop being integrated until something moves next to them
+	bool sleeping = false;
+	float sleepVelocity = 10.0f;
+	float sleepTime = 0.5f;
+
+	//Samples the mass independent force fields once into a texture with texels of forceFieldResolution world units,
+	//particles then read it with a bilinear lookup instead of evaluating the fields
+	bool bakeForceFields = false;
+	float forceFieldResolution = 4.0f;
+
+	//Steps with the fixed timestep, seeds the spawners and fixes the pair order, so runs repeat bit for bit on any thread count
+	//Timing based tuning is disabled, the SIMD paths are fixed to the baseline of the architecture (SSE on x64) instead of the best one the cpu has,
+	//a checksum of the particle state is taken after every step
+	bool deterministic = false;
+	uint32_t seed = 0;
 
 	SolverSettings(SolverUpdateMode updateMode, float timestep, uint32_t substeps, Vector2 gravity, float partitioningSize, bool collision)
 		: updateMode(updateMode), timestep(timestep), substeps(substeps), gravity(gravity), partitioningSize(partitioningSize), collision(collision) { }
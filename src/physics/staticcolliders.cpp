@@ -0,0 +1,215 @@
+#include "staticcolliders.h"
+#include <cmath>
+#include <array>
+#include <limits>
+#include <algorithm>
+
+void StaticColliders::Build(const std::vector<Segment>& segments)
+{
+	this->segments.clear();
+	nodes.clear();
+	if(segments.empty())
+	{
+		return;
+	}
+
+	std::vector<Segment> build = segments;
+	BuildNode(build, 0, static_cast<uint32_t>(build.size()), 0);
+
+	this->segments.reserve(build.size());
+	for(const Segment& s : build)
+	{
+		const Vector2 dir = s.to - s.from;
+		const float sqrLength = dir.SqrLength();
+		const Vector2 normal = sqrLength > 0.0f ? Vector2(-dir.y, dir.x) / std::sqrtf(sqrLength) : Vector2::up;
+		this->segments.push_back({ s.from, dir, normal, sqrLength > 0.0f ? 1.0f / sqrLength : 0.0f, s.radius });
+	}
+}
+
+bool StaticColliders::Resolve(Vector2& pos, float radius) const
+{
+	if(nodes.empty())
+	{
+		return false;
+	}
+
+	bool moved = false;
+	std::array<uint32_t, maxDepth> stack;
+	size_t top = 0;
+	stack[top++] = 0;
+	while(top > 0)
+	{
+		const uint32_t index = stack[--top];
+		const Node& node = nodes[index];
+		if(pos.x + radius < node.min.x || pos.x - radius > node.max.x || pos.y + radius < node.min.y || pos.y - radius > node.max.y)
+		{
+			continue;
+		}
+
+		if(node.count > 0)
+		{
+			for(uint32_t i = node.start; i < node.start + node.count; i++)
+			{
+				moved |= Push(segments[i], pos, radius);
+			}
+			continue;
+		}
+		stack[top++] = node.start;
+		stack[top++] = index + 1;
+	}
+	return moved;
+}
+
+bool StaticColliders::Sweep(Vector2 from, Vector2 to, float radius, float& t, Vector2& normal) const
+{
+	if(nodes.empty())
+	{
+		return false;
+	}
+
+	const Vector2 min = Vector2(std::min(from.x, to.x) - radius, std::min(from.y, to.y) - radius);
+	const Vector2 max = Vector2(std::max(from.x, to.x) + radius, std::max(from.y, to.y) + radius);
+	const Vector2 delta = to - from;
+	bool hit = false;
+	std::array<uint32_t, maxDepth> stack;
+	size_t top = 0;
+	stack[top++] = 0;
+	while(top > 0)
+	{
+		const uint32_t index = stack[--top];
+		const Node& node = nodes[index];
+		if(max.x < node.min.x || min.x > node.max.x || max.y < node.min.y || min.y > node.max.y)
+		{
+			continue;
+		}
+
+		if(node.count > 0)
+		{
+			for(uint32_t i = node.start; i < node.start + node.count; i++)
+			{
+				hit |= Intersect(segments[i], from, delta, radius, t, normal);
+			}
+			continue;
+		}
+		stack[top++] = node.start;
+		stack[top++] = index + 1;
+	}
+	return hit;
+}
+
+void StaticColliders::BuildNode(std::vector<Segment>& build, uint32_t begin, uint32_t end, size_t depth)
+{
+	//Bounds include the radius, so a particle only has to overlap them to be tested
+	Vector2 min = Vector2(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+	Vector2 max = Vector2(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+	Vector2 centerMin = min;
+	Vector2 centerMax = max;
+	for(uint32_t i = begin; i < end; i++)
+	{
+		const Segment& s = build[i];
+		min.x = std::min({ min.x, s.from.x - s.radius, s.to.x - s.radius });
+		min.y = std::min({ min.y, s.from.y - s.radius, s.to.y - s.radius });
+		max.x = std::max({ max.x, s.from.x + s.radius, s.to.x + s.radius });
+		max.y = std::max({ max.y, s.from.y + s.radius, s.to.y + s.radius });
+		const Vector2 center = (s.from + s.to) * 0.5f;
+		centerMin = Vector2(std::min(centerMin.x, center.x), std::min(centerMin.y, center.y));
+		centerMax = Vector2(std::max(centerMax.x, center.x), std::max(centerMax.y, center.y));
+	}
+
+	const uint32_t index = static_cast<uint32_t>(nodes.size());
+	nodes.push_back({ min, max, begin, end - begin });
+	//Every level pushes one more node onto the traversal stack
+	if(end - begin <= leafSize || depth + 2 >= maxDepth)
+	{
+		return;
+	}
+
+	//Median split along the axis the segment centers spread the most on
+	const bool splitX = centerMax.x - centerMin.x >= centerMax.y - centerMin.y;
+	const uint32_t mid = begin + (end - begin) / 2;
+	std::nth_element(build.begin() + begin, build.begin() + mid, build.begin() + end, [splitX](const Segment& a, const Segment& b)
+	{
+		return splitX ? a.from.x + a.to.x < b.from.x + b.to.x : a.from.y + a.to.y < b.from.y + b.to.y;
+	});
+
+	BuildNode(build, begin, mid, depth + 1);
+	nodes[index].start = static_cast<uint32_t>(nodes.size());
+	nodes[index].count = 0;
+	BuildNode(build, mid, end, depth + 1);
+}
+
+bool StaticColliders::Push(const PreparedSegment& segment, Vector2& pos, float radius)
+{
+	//Closest point on the segment
+	const float t = std::clamp(Vector2::Dot(pos - segment.from, segment.dir) * segment.invSqrLength, 0.0f, 1.0f);
+	const Vector2 closest = segment.from + segment.dir * t;
+	const Vector2 toPos = pos - closest;
+	const float minDst = radius + segment.radius;
+	const float sqrDst = toPos.SqrLength();
+	if(sqrDst >= minDst * minDst)
+	{
+		return false;
+	}
+
+	if(sqrDst > 1e-8f)
+	{
+		pos = closest + toPos * (minDst / std::sqrtf(sqrDst));
+	}
+	else
+	{
+		pos = closest + segment.normal * minDst;
+	}
+	return true;
+}
+
+bool StaticColliders::Intersect(const PreparedSegment& segment, Vector2 from, Vector2 delta, float radius, float& t, Vector2& normal)
+{
+	const float minDst = radius + segment.radius;
+	const float sqrMinDst = minDst * minDst;
+	auto closest = [&](Vector2 pos)
+	{
+		return segment.from + segment.dir * std::clamp(Vector2::Dot(pos - segment.from, segment.dir) * segment.invSqrLength, 0.0f, 1.0f);
+	};
+	if((from - closest(from)).SqrLength() <= sqrMinDst)
+	{
+		return false;
+	}
+
+	//The capsule grown by the particle radius is made of a circle around each end and the two sides in between
+	float hitT = t;
+	const float a = delta.SqrLength();
+	for(const Vector2& center : { segment.from, segment.from + segment.dir })
+	{
+		const Vector2 m = from - center;
+		const float b = Vector2::Dot(m, delta);
+		const float disc = b * b - a * (m.SqrLength() - sqrMinDst);
+		if(b < 0.0f && disc >= 0.0f)
+		{
+			hitT = std::min(hitT, (-b - std::sqrtf(disc)) / a);
+		}
+	}
+
+	const float approach = Vector2::Dot(delta, segment.normal);
+	if(approach != 0.0f)
+	{
+		const float offset = Vector2::Dot(from - segment.from, segment.normal);
+		//Only the side the particle starts on can be hit first
+		const float side = offset >= 0.0f ? minDst : -minDst;
+		const float sideT = (side - offset) / approach;
+		const float along = Vector2::Dot(from + delta * sideT - segment.from, segment.dir) * segment.invSqrLength;
+		if(sideT >= 0.0f && along >= 0.0f && along <= 1.0f)
+		{
+			hitT = std::min(hitT, sideT);
+		}
+	}
+
+	if(hitT >= t)
+	{
+		return false;
+	}
+
+	const Vector2 contact = from + delta * hitT;
+	t = hitT;
+	normal = (contact - closest(contact)) / minDst;
+	return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "structs/vector2.h"
+#include <cstdint>
+#include <vector>
+
+//Segments which never move, particles collide with the capsule of each segment's radius
+//The segments are kept in a bounding volume hierarchy, so a particle only tests the few segments close to it
+class StaticColliders
+{
+public:
+	struct Segment
+	{
+		Vector2 from;
+		Vector2 to;
+		float radius;
+	};
+
+	void Build(const std::vector<Segment>& segments);
+	size_t SegmentCount() const { return segments.size(); }
+	bool Empty() const { return segments.empty(); }
+	//Pushes a particle out of every capsule it overlaps, returns whether it was moved
+	bool Resolve(Vector2& pos, float radius) const;
+	//Finds the first capsule a particle moving from from to to runs into before the fraction t of the way,
+	//capsules it already overlaps at the start are left to Resolve. On a hit t and the normal at the contact are updated
+	bool Sweep(Vector2 from, Vector2 to, float radius, float& t, Vector2& normal) const;
+
+private:
+	static constexpr uint32_t leafSize = 4;
+	static constexpr size_t maxDepth = 64;
+
+	struct PreparedSegment
+	{
+		Vector2 from;
+		Vector2 dir;
+		//Pushes particles lying exactly on the segment
+		Vector2 normal;
+		float invSqrLength;
+		float radius;
+	};
+
+	//Children of inner nodes are the next node and the node at start, leaves own count segments from start
+	struct Node
+	{
+		Vector2 min;
+		Vector2 max;
+		uint32_t start;
+		uint32_t count;
+	};
+
+	std::vector<PreparedSegment> segments = {};
+	std::vector<Node> nodes = {};
+
+	void BuildNode(std::vector<Segment>& build, uint32_t begin, uint32_t end, size_t depth);
+	static bool Push(const PreparedSegment& segment, Vector2& pos, float radius);
+	static bool Intersect(const PreparedSegment& segment, Vector2 from, Vector2 delta, float radius, float& t, Vector2& normal);
+};
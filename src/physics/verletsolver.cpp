@@ -1,31 +1,46 @@
 #include "verletsolver.h"
 #include "structs/vector2.h"
 #include "simulation/components.h"
+#include "utils/math.h"
 #include <cmath>
+#include <numeric>
+#include <algorithm>
 #include <exception>
 #include <limits>
 #include <utility>
+#include <array>
+#include <bit>
 
-inline Vector2 CalcMassRatio(Particle& a, Particle& b)
+inline Vector2 CalcMassRatio(float aInvMass, float bInvMass)
 {
-	float aMul = static_cast<float>(!a.pinned);
-	float bMul = static_cast<float>(!b.pinned);
-	float massSum = a.mass * aMul + b.mass * bMul;
-	float invMassSum = massSum != 0.0f ? (1.0f / massSum) : 0.0f;
-	aMul *= b.mass * invMassSum;
-	bMul *= a.mass * invMassSum;
-	return Vector2(aMul, bMul);
+	//Pinned particles have an inverse mass of 0 and therefore don't move
+	//The other particle of a pinned pair takes the whole correction, regardless of the masses of both
+	float invMassSum = aInvMass + bInvMass;
+	float norm = invMassSum != 0.0f ? (1.0f / invMassSum) : 0.0f;
+	return Vector2(aInvMass * norm, bInvMass * norm);
 }
 
 VerletSolver::VerletSolver(EcsWorld& ecs, IConstraint& constraint, const SolverSettings& settings)
-	: ecs(ecs), constraint(constraint), timeStep(settings.timestep), gravity(settings.gravity), substeps(settings.substeps), partitioningSize(settings.partitioningSize),
-	collision(settings.collision), updateMode(settings.updateMode), partitioning(constraint.Bounds().first, constraint.Bounds().second, settings.partitioningSize)
+	: ecs(ecs), constraint(constraint), timeStep(settings.timestep), deterministic(settings.deterministic), gravity(settings.gravity), substeps(settings.substeps), adaptiveSubsteps(settings.adaptiveSubsteps), minSubsteps(settings.minSubsteps), maxSubsteps(settings.maxSubsteps), multiRateSubsteps(settings.multiRateSubsteps), maxSubstepStride(settings.maxSubstepStride), autoPartitioning(settings.autoPartitioning && !settings.deterministic),
+	bakeForceFields(settings.bakeForceFields), forceFieldResolution(settings.forceFieldResolution),
+	collision(settings.collision), collisionMode(settings.collisionMode), relaxation(settings.relaxation), adaptiveIterations(settings.adaptiveIterations), maxIterations(settings.maxIterations), overlapTolerance(settings.overlapTolerance), neighborLists(settings.neighborLists), neighborSkin(settings.neighborSkin), temporalBlocking(settings.temporalBlocking), blockSubsteps(settings.blockSubsteps), continuousCollision(settings.continuousCollision), ccdThreshold(settings.ccdThreshold), sleeping(settings.sleeping), sleepVelocity(settings.sleepVelocity), sleepTime(settings.sleepTime), updateMode(settings.updateMode), simdLevel(settings.deterministic ? Cpu::BaselineSimdLevel() : Cpu::DetectSimdLevel()), reorderInterval(settings.reorderInterval),
+	partitioning(constraint.Bounds().first, constraint.Bounds().second, settings.partitioningSize, settings.partitioningLevels), partitioningTuner(settings.partitioningSize)
 {
 
 }
 
 void VerletSolver::Update(float dt)
 {
+	SyncParticles();
+	if(reorderInterval > 0 && ++framesSinceReorder >= reorderInterval)
+	{
+		ReorderParticles();
+		framesSinceReorder = 0;
+	}
+	BuildLinks();
+	BuildForceFields();
+	BuildColliders();
+
 	switch(updateMode)
 	{
 		case SolverUpdateMode::FrameDeltaTime:
@@ -40,12 +55,11 @@ void VerletSolver::Update(float dt)
 		}
 		case SolverUpdateMode::FixedFrameRate:
 		{
-			static float timer = 0.0f;
-			timer += std::fminf(dt, 0.25f);
-			while(timer >= timeStep)
+			stepTimer += std::fminf(dt, 0.25f);
+			while(stepTimer >= timeStep)
 			{
 				Simulate(timeStep);
-				timer -= timeStep;
+				stepTimer -= timeStep;
 			}
 			break;
 		}
@@ -53,280 +67,2597 @@ void VerletSolver::Update(float dt)
 			throw std::exception("[VerletSolver::Update] Missing switch case!");
 	}
 
+	WriteTransforms();
 	CollectStats();
 }
 
-void VerletSolver::Simulate(float dt)
+void VerletSolver::SyncParticles()
 {
-	unsigned int steps = std::max(substeps, 1u);
-	float stepDt = dt / static_cast<float>(steps);
-	for(unsigned int i = 0; i < steps; i++)
+	//Particles are only ever appended to their archetype, so everything past the synced count of an archetype is new
+	//New particles go to the end of the storage, the next reorder moves them next to their neighbors
+	ecs.QueryArchetypeEntities<Transform, Particle>([&](const ArchetypeId& id, const Entity* e, Transform* t, Particle* p, size_t count)
 	{
-		if(collision)
+		SyncedArchetype& synced = syncedArchetypes[id];
+		if(count <= synced.count)
 		{
-			Collisions();
+			return;
 		}
-		UpdateObjects(stepDt);
-		UpdateLinks(stepDt);
+
+		const uint32_t begin = static_cast<uint32_t>(particles.Size());
+		const uint32_t added = static_cast<uint32_t>(count - synced.count);
+		particles.Append(e + synced.count, t + synced.count, p + synced.count, added);
+		partitioningTuner.AddRadii(particles.radius.data() + begin, added);
+		if(!synced.runs.empty() && synced.runs.back().begin + synced.runs.back().count == begin)
+		{
+			synced.runs.back().count += added;
+		}
+		else
+		{
+			synced.runs.push_back({ begin, added });
+		}
+		synced.count = count;
+	});
+
+	//Has to happen before the next collision pass, whether the cell size is tuned or fixed
+	if(std::optional<float> cellSize = partitioningTuner.Fit())
+	{
+		RebuildPartitioning(cellSize.value());
 	}
 }
 
-void VerletSolver::Collisions()
+void VerletSolver::ReorderParticles()
 {
-	static const std::array<std::pair<int32_t, int32_t>, 4> cellOffsets =
+	//Particles sharing a cell or neighboring cells end up close to each other in memory
+	//The ecs archetypes are reordered the same way, so storage segments mirror them again afterwards
+	std::vector<uint32_t> keys = std::vector<uint32_t>(particles.Size());
+	for(size_t i = 0; i < keys.size(); i++)
 	{
-		std::make_pair(1, 1),
-		std::make_pair(1, 0),
-		std::make_pair(1, -1),
-		std::make_pair(0, -1)
-	};
-	const int32_t cellsX = partitioning.CellsX();
-	const int32_t cellsY = partitioning.CellsY();
-	const int32_t lastXCell = cellsX - 1;
-	const int32_t lastYCell = cellsY - 1;
+		auto [cx, cy] = partitioning.CellCoords(particles.Position(i));
+		keys[i] = Math::Morton2D(static_cast<uint32_t>(cx), static_cast<uint32_t>(cy));
+	}
 
-	ecs.QueryChunked<Transform, Particle>(std::numeric_limits<size_t>::max(), [&](Transform* t, Particle* p, size_t chunkSize)
+	//Every archetype is sorted on its own and gets one segment of the storage, which gathers the runs synced since the last reorder
+	std::vector<uint32_t> order = {};
+	order.reserve(particles.Size());
+	std::map<ArchetypeId, std::vector<uint32_t>> archetypeOrders = {};
+	for(auto& [id, synced] : syncedArchetypes)
 	{
-		broadPhaseCounter.BeginSubFrame();
-		partitioning.Clear();
-		for(size_t i = 0; i < chunkSize; i++)
+		if(synced.count == 0)
 		{
-			partitioning.Insert(&t[i], &p[i]);
+			continue;
 		}
-		broadPhaseCounter.EndSubFrame();
 
-		narrowPhaseCounter.BeginSubFrame();
-		for(const auto& [offset, amount] : ThreadPool::SplitWork(cellsX, threadPool.ThreadCount()))
+		//Storage index of every particle of the archetype, in the order of the archetype
+		std::vector<uint32_t> indices = {};
+		indices.reserve(synced.count);
+		for(const StorageRun& run : synced.runs)
 		{
-			threadPool.EnqueueJob([this, offset, amount, cellsY, lastXCell, lastYCell]
+			for(uint32_t i = 0; i < run.count; i++)
 			{
-				for(int32_t i = offset; i < offset + amount; i++)
-				{
-					for(int32_t k = 0; k < cellsY; k++)
-					{
-						PartitioningCell& cell = partitioning.At(i, k);
-						SolveCell(cell);
+				indices.push_back(run.begin + i);
+			}
+		}
 
-						for(const auto& [xOff, yOff] : cellOffsets)
-						{
-							int32_t x = i + xOff;
-							int32_t y = k + yOff;
-							if(((static_cast<uint32_t>(x) > lastXCell) | (static_cast<uint32_t>(y) > lastYCell)) != 0)
-							{
-								continue;
-							}
+		std::vector<uint32_t>& archetypeOrder = archetypeOrders[id];
+		archetypeOrder.resize(indices.size());
+		std::iota(archetypeOrder.begin(), archetypeOrder.end(), 0u);
+		std::sort(archetypeOrder.begin(), archetypeOrder.end(), [&](uint32_t a, uint32_t b)
+		{
+			return keys[indices[a]] < keys[indices[b]] || (keys[indices[a]] == keys[indices[b]] && a < b);
+		});
 
-							SolveCells(cell, partitioning.At(x, y));
-						}
-					}
-				}
-			});
+		const uint32_t begin = static_cast<uint32_t>(order.size());
+		for(uint32_t k : archetypeOrder)
+		{
+			order.push_back(indices[k]);
 		}
-		threadPool.WaitForCompletion();
-		narrowPhaseCounter.EndSubFrame();
-	});
+		synced.runs.assign(1, { begin, static_cast<uint32_t>(synced.count) });
+	}
+
+	const bool linksCurrent = linkStorageVersion == particles.Version();
+	particles.Reorder(order);
+	ecs.Reorder(archetypeOrders);
+	if(linksCurrent)
+	{
+		RemapLinks(order);
+	}
 }
 
-void VerletSolver::SolveCell(PartitioningCell& cell)
+void VerletSolver::RemapLinks(const std::vector<uint32_t>& order)
 {
-	size_t count = cell.size();
-	for(size_t i = 0; i < count; i++)
+	//Only the particle indices change, the classes stay free of shared particles under any numbering
+	std::vector<uint32_t> remap = std::vector<uint32_t>(order.size());
+	for(size_t i = 0; i < order.size(); i++)
 	{
-		PartitioningCellEntry& a = cell[i];
-		for(size_t k = i + 1; k < count; k++)
-		{
-			PartitioningCellEntry& b = cell[k];
-			Solve(*a.t, *a.p, *b.t, *b.p);
-		}
+		remap[order[i]] = static_cast<uint32_t>(i);
+	}
+	for(SolverLink& link : links)
+	{
+		link.a = remap[link.a];
+		link.b = remap[link.b];
+	}
+	for(auto& [a, b] : linkParticles)
+	{
+		a = remap[a];
+		b = remap[b];
 	}
+	linkStorageVersion = particles.Version();
 }
 
-void VerletSolver::SolveCells(PartitioningCell& cell0, PartitioningCell& cell1)
+void VerletSolver::WriteTransforms()
 {
-	for(PartitioningCellEntry& a : cell0)
+	ecs.QueryArchetypeEntities<Transform, Particle>([&](const ArchetypeId& id, const Entity* _, Transform* t, Particle* __, size_t count)
 	{
-		for(PartitioningCellEntry& b : cell1)
+		auto it = syncedArchetypes.find(id);
+		if(it == syncedArchetypes.end())
 		{
-			Solve(*a.t, *a.p, *b.t, *b.p);
+			return;
 		}
-	}
+		for(const StorageRun& run : it->second.runs)
+		{
+			for(uint32_t i = 0; i < run.count; i++)
+			{
+				t[i].Position() = particles.Position(run.begin + i);
+			}
+			t += run.count;
+		}
+	});
+
+	size_t link = 0;
+	ecs.QueryChunked<Transform, Link>(std::numeric_limits<size_t>::max(), [&](Transform* t, Link* _, size_t count)
+	{
+		for(size_t i = 0; i < count; i++, link++)
+		{
+			t[i].value = Matrix4::Line(particles.Position(linkParticles[link].first), particles.Position(linkParticles[link].second));
+		}
+	});
 }
 
-void VerletSolver::Solve(Transform& aTransform, Particle& a, Transform& bTransform, Particle& b)
+void VerletSolver::Simulate(float dt)
 {
-	Vector2& aPos = aTransform.Position();
-	Vector2& bPos = bTransform.Position();
-	Vector2 dir = aPos - bPos;
-	float dst = std::max(dir.SqrLength(), 0.001f);
-	float r = a.radius + b.radius;
-	r *= r;
-	if(dst < r)
+	unsigned int steps = adaptiveSubsteps ? AdaptiveSubsteps(dt) : std::max(substeps, 1u);
+	float stepDt = dt / static_cast<float>(steps);
+	//Verlet velocities are displacements per substep, so they have to follow a change of the substep count
+	if(lastSubsteps > 0 && steps != lastSubsteps)
 	{
-		dst = std::sqrtf(dst);
-		Vector2 normDir = dir / dst;
-		float overlap = a.radius + b.radius - dst;
+		RescaleVelocities(static_cast<float>(lastSubsteps) / static_cast<float>(steps));
+	}
+	lastSubsteps = steps;
+	lastStepDt = stepDt;
+
+	//Cells are found in the grid, which is only built with collisions
+	const bool multiRate = multiRateSubsteps && collision;
+	if(multiRateActive && !multiRate)
+	{
+		ResetRates();
+	}
+	multiRateActive = multiRate;
+	maxRateShift = 0;
+	while(multiRate && (2u << maxRateShift) <= maxSubstepStride && steps % (2u << maxRateShift) == 0)
+	{
+		maxRateShift++;
+	}
+	particleSteps += static_cast<uint64_t>(particles.Size()) * steps;
+
+	//Substeps of an undone block run one at a time, the regular lists check rebuilds the lists in time
+	uint32_t unblocked = 0;
+	for(substep = 0; substep < steps; substep++)
+	{
+		if(const uint32_t block = substep >= unblocked ? BlockLength(steps - substep) : 1; block > 1)
+		{
+			if(SimulateBlock(stepDt, block))
+			{
+				substep += block - 1;
+				continue;
+			}
+			unblocked = substep + block;
+		}
+
+		if(collision)
+		{
+			Collisions();
+		}
+		UpdateObjects(stepDt);
+		if(collision && continuousCollision)
+		{
+			ContinuousCollisions();
+		}
+		UpdateLinks(stepDt);
+	}
 
-		auto [aMul, bMul] = CalcMassRatio(a, b);
-		aPos += normDir * (overlap * aMul);
-		bPos -= normDir * (overlap * bMul);
+	stepCount++;
+	if(deterministic)
+	{
+		checksum = StateChecksum();
 	}
 }
 
-void VerletSolver::UpdateObjects(float dt)
+uint32_t VerletSolver::AdaptiveSubsteps(float dt) const
 {
-	updatePhaseCounter.BeginSubFrame();
+	const uint32_t minSteps = std::max(minSubsteps, 1u);
+	const uint32_t maxSteps = std::max(maxSubsteps, minSteps);
+	const float maxTravel = partitioningTuner.MinRadius() * maxSubstepTravel;
+	if(lastStepDt <= 0.0f || maxTravel <= 0.0f)
+	{
+		return maxSteps;
+	}
+
+	//The fastest particle of the last substep is assumed to keep its speed over the whole step
+	const float travel = std::sqrtf(maxSqrStep.load()) * dt / lastStepDt;
+	const float steps = std::ceilf(travel / maxTravel);
+	return steps >= static_cast<float>(maxSteps) ? maxSteps : std::max(static_cast<uint32_t>(steps), minSteps);
+}
 
-	ecs.WithAllOfComponent<ForceField>([&](std::span<const ForceField> forceFields)
+void VerletSolver::RescaleVelocities(float scale)
+{
+	for(const auto& [offset, amount] : ThreadPool::SplitWork(particles.Size(), threadPool.ThreadCount()))
 	{
-		ecs.QueryMT<Transform, Particle>(std::nullopt, [this, dt, forceFields](Transform& t, Particle& p)
+		if(amount == 0)
+		{
+			continue;
+		}
+
+		threadPool.EnqueueJob([this, scale, offset, amount]
 		{
-			if(p.pinned)
+			for(size_t i = offset; i < offset + amount; i++)
 			{
-				return;
+				particles.prevX[i] = particles.posX[i] - (particles.posX[i] - particles.prevX[i]) * scale;
+				particles.prevY[i] = particles.posY[i] - (particles.posY[i] - particles.prevY[i]) * scale;
 			}
+		});
+	}
+	threadPool.WaitForCompletion();
+}
 
-			//Make sure applied forces (like initial) are represented as force over 1 second to make it delta time and substep independent
-			p.acc *= (1.0f / dt);
-
-			//Apply mass to forces
-			p.acc /= p.mass;
+void VerletSolver::AssignRates()
+{
+	const PartitioningGrid& tiles = partitioning.Level(0);
+	const int32_t tilesX = tiles.CellsX();
+	const int32_t tilesY = tiles.CellsY();
+	tileTravel.assign(tiles.CellCount(), 0.0f);
+	tileRates.resize(tiles.CellCount());
+	nextTileRates.resize(tiles.CellCount());
+	const std::vector<std::pair<size_t, size_t>> columns = ThreadPool::SplitWork(tilesX, threadPool.ThreadCount());
 
-			//Gravity
-			p.acc.x += gravity.x;
-			p.acc.y += gravity.y;
+	//Jobs own whole columns of the coarsest level and the columns of the finer levels inside of them
+	for(const auto& [offset, amount] : columns)
+	{
+		threadPool.EnqueueJob([this, tilesY, offset, amount]
+		{
+			for(uint32_t level = 0; level < partitioning.LevelCount(); level++)
+			{
+				const PartitioningGrid& grid = partitioning.Level(level);
+				const uint32_t cellsY = static_cast<uint32_t>(grid.CellsY());
+				grid.ForEachCell(static_cast<uint32_t>(offset << level) * cellsY, static_cast<uint32_t>((offset + amount) << level) * cellsY, [&](uint32_t cell, PartitioningCell cellParticles)
+				{
+					float travel = 0.0f;
+					for(uint32_t i : cellParticles)
+					{
+						if(!particles.IsResting(i))
+						{
+							const float stride = static_cast<float>(1u << particles.rateShift[i]);
+							travel = std::max(travel, (particles.Position(i) - particles.PrevPosition(i)).SqrLength() / (stride * stride));
+						}
+					}
+					float& tile = tileTravel[((cell / cellsY) >> level) * tilesY + ((cell % cellsY) >> level)];
+					tile = std::max(tile, travel);
+				});
+			}
+		});
+	}
+	threadPool.WaitForCompletion();
 
-			for(const ForceField& forceField : forceFields)
+	//Each cell takes the largest stride which keeps its particles below the same travel limit as adaptive substeps
+	const float maxTravel = partitioningTuner.MinRadius() * maxSubstepTravel;
+	for(const auto& [offset, amount] : columns)
+	{
+		threadPool.EnqueueJob([this, tilesY, maxTravel, offset, amount]
+		{
+			for(size_t tile = offset * tilesY; tile < (offset + amount) * tilesY; tile++)
 			{
-				p.acc += CalcForceField(forceField, p, t.Position());
+				const float travel = std::sqrtf(tileTravel[tile]);
+				uint8_t rate = 0;
+				while(rate < maxRateShift && travel * static_cast<float>(2u << rate) <= maxTravel)
+				{
+					rate++;
+				}
+				nextTileRates[tile] = rate;
 			}
+		});
+	}
+	threadPool.WaitForCompletion();
 
-			//Constrain
-			constraint.Contrain(t.Position(), p);
+	//The cells around a cell take its rate and every further ring may double the stride, so particles crossing
+	//into a slower cell during the step only meet particles at most one rate below theirs
+	for(uint8_t pass = 0; pass <= maxRateShift; pass++)
+	{
+		const uint8_t falloff = pass == 0 ? 0 : 1;
+		for(const auto& [offset, amount] : columns)
+		{
+			threadPool.EnqueueJob([this, tilesX, tilesY, falloff, offset, amount]
+			{
+				for(int32_t x = static_cast<int32_t>(offset); x < static_cast<int32_t>(offset + amount); x++)
+				{
+					for(int32_t y = 0; y < tilesY; y++)
+					{
+						uint8_t rate = nextTileRates[x * tilesY + y];
+						for(int32_t nx = std::max(x - 1, 0); nx <= std::min(x + 1, tilesX - 1); nx++)
+						{
+							for(int32_t ny = std::max(y - 1, 0); ny <= std::min(y + 1, tilesY - 1); ny++)
+							{
+								rate = std::min(rate, static_cast<uint8_t>(nextTileRates[nx * tilesY + ny] + falloff));
+							}
+						}
+						tileRates[x * tilesY + y] = rate;
+					}
+				}
+			});
+		}
+		threadPool.WaitForCompletion();
+		std::swap(tileRates, nextTileRates);
+	}
+	std::swap(tileRates, nextTileRates);
 
-			//Update
-			Vector2& pos = t.Position();
-			const Vector2 vel = pos - p.prevPos;
-			p.prevPos = pos;
-			pos += vel + p.acc * (dt * dt);
-			p.acc = Vector2::zero;
+	//Every particle is in sync at the start of a step, so it can change its stride by rescaling its velocity
+	rateKeys.resize(particles.Size());
+	for(const auto& [offset, amount] : columns)
+	{
+		threadPool.EnqueueJob([this, tilesX, tilesY, offset, amount]
+		{
+			for(uint32_t level = 0; level < partitioning.LevelCount(); level++)
+			{
+				const PartitioningGrid& grid = partitioning.Level(level);
+				const uint32_t cellsY = static_cast<uint32_t>(grid.CellsY());
+				grid.ForEachCell(static_cast<uint32_t>(offset << level) * cellsY, static_cast<uint32_t>((offset + amount) << level) * cellsY, [&](uint32_t cell, PartitioningCell cellParticles)
+				{
+					const int32_t x = static_cast<int32_t>((cell / cellsY) >> level);
+					const int32_t y = static_cast<int32_t>((cell % cellsY) >> level);
+					const uint8_t rate = tileRates[x * tilesY + y];
+					//Cells next to a faster one hold the waiting particles the faster ones can run into, neighboring cells differ by at most one rate
+					bool border = false;
+					for(int32_t nx = std::max(x - 1, 0); nx <= std::min(x + 1, tilesX - 1); nx++)
+					{
+						for(int32_t ny = std::max(y - 1, 0); ny <= std::min(y + 1, tilesY - 1); ny++)
+						{
+							border |= tileRates[nx * tilesY + ny] < rate;
+						}
+					}
+					const uint8_t key = static_cast<uint8_t>(rate * 2 + (border ? 0 : 1));
+					for(uint32_t i : cellParticles)
+					{
+						rateKeys[i] = key;
+						if(particles.rateShift[i] == rate)
+						{
+							continue;
+						}
+						const float scale = std::ldexp(1.0f, static_cast<int>(rate) - static_cast<int>(particles.rateShift[i]));
+						particles.prevX[i] = particles.posX[i] - (particles.posX[i] - particles.prevX[i]) * scale;
+						particles.prevY[i] = particles.posY[i] - (particles.posY[i] - particles.prevY[i]) * scale;
+						particles.rateShift[i] = rate;
+					}
+				});
+			}
 		});
-	});
-
-	updatePhaseCounter.EndSubFrame();
+	}
+	threadPool.WaitForCompletion();
 }
 
-void VerletSolver::UpdateLinks(float dt)
+void VerletSolver::SortByRate()
 {
-	linkPhaseCounter.BeginSubFrame();
-	ecs.Query<Transform, Link>([this, dt](Transform& t, Link& l)
+	//Counting sort by key, parallel over ranges of the storage, which keeps the particles of a key in storage order
+	const size_t keyCount = (maxRateShift + 1u) * 2u;
+	const std::vector<std::pair<size_t, size_t>> jobs = ThreadPool::SplitWork(particles.Size(), threadPool.ThreadCount());
+	jobRateCounts.resize(jobs.size());
+	for(size_t job = 0; job < jobs.size(); job++)
 	{
-		Vector2& aPos = ecs.GetComponent<Transform>(l.e0)->Position();
-		Vector2& bPos = ecs.GetComponent<Transform>(l.e1)->Position();
-		Particle& a = *ecs.GetComponent<Particle>(l.e0);
-		Particle& b = *ecs.GetComponent<Particle>(l.e1);
+		jobRateCounts[job].assign(keyCount, 0);
+		threadPool.EnqueueJob([this, job, offset = jobs[job].first, amount = jobs[job].second]
+		{
+			std::vector<uint32_t>& counts = jobRateCounts[job];
+			for(size_t i = offset; i < offset + amount; i++)
+			{
+				if(!particles.HasFlag(i, ParticleFlags::Pinned))
+				{
+					counts[rateKeys[i]]++;
+				}
+			}
+		});
+	}
+	threadPool.WaitForCompletion();
 
-		Vector2 dir = (bPos - aPos);
-		float len = dir.Normalize();
-		float off = len - l.distance;
-		if((l.restrictMax && off > 0.0f) || (l.restrictMin && off < 0.0f))
+	rateKeyStarts.assign(keyCount + 1, 0);
+	uint32_t sum = 0;
+	for(size_t key = 0; key < keyCount; key++)
+	{
+		rateKeyStarts[key] = sum;
+		for(std::vector<uint32_t>& counts : jobRateCounts)
 		{
-			auto [aMul, bMul] = CalcMassRatio(a, b);
-			aPos += dir * (off * aMul);
-			bPos -= dir * (off * bMul);
+			const uint32_t count = counts[key];
+			counts[key] = sum;
+			sum += count;
 		}
-		t.value = Matrix4::Line(aPos, bPos);
-	});
-	linkPhaseCounter.EndSubFrame();
+	}
+	rateKeyStarts[keyCount] = sum;
+	rateParticles.resize(sum);
+
+	for(size_t job = 0; job < jobs.size(); job++)
+	{
+		threadPool.EnqueueJob([this, job, offset = jobs[job].first, amount = jobs[job].second]
+		{
+			std::vector<uint32_t>& fill = jobRateCounts[job];
+			for(size_t i = offset; i < offset + amount; i++)
+			{
+				if(!particles.HasFlag(i, ParticleFlags::Pinned))
+				{
+					rateParticles[fill[rateKeys[i]]++] = static_cast<uint32_t>(i);
+				}
+			}
+		});
+	}
+	threadPool.WaitForCompletion();
 }
 
-Vector2 VerletSolver::CalcForceField(const ForceField& field, Particle& particle, Vector2 pos)
+void VerletSolver::UpdateWaiting()
 {
-	const ForceFieldSettings& s = field.settings;
-	const Vector2 toPos = pos - field.pos;
-	const float eps = 1e-5f;
+	//Particles only take the substeps ending a stride of theirs, the last substep of a step ends all of them
+	//Rates are always in sync with all faster ones, so only the rates between the last and the running active one change
+	const uint8_t lastRateShift = substep == 0 ? maxRateShift : activeRateShift;
+	activeRateShift = static_cast<uint8_t>(std::min<uint32_t>(std::countr_zero(substep + 1), maxRateShift));
+	if(lastRateShift == activeRateShift)
+	{
+		return;
+	}
 
-	Vector2 local = toPos;
-	Vector2 halfRectSize = s.rectSize * 0.5f;
-	if(s.shape == ForceFieldShape::Circle)
+	const bool waiting = activeRateShift < lastRateShift;
+	const size_t begin = rateKeyStarts[(std::min(lastRateShift, activeRateShift) + 1u) * 2u];
+	const size_t end = rateKeyStarts[(std::max(lastRateShift, activeRateShift) + 1u) * 2u];
+	for(const auto& [offset, amount] : ThreadPool::SplitWork(end - begin, threadPool.ThreadCount()))
 	{
-		float r2 = s.range * s.range;
-		if(toPos.SqrLength() > r2)
+		if(amount == 0)
 		{
-			return Vector2::zero;
+			continue;
 		}
+
+		threadPool.EnqueueJob([this, waiting, offset = begin + offset, amount]
+		{
+			for(size_t k = offset; k < offset + amount; k++)
+			{
+				if(waiting)
+				{
+					particles.SetFlag(rateParticles[k], ParticleFlags::Waiting);
+				}
+				else
+				{
+					particles.ClearFlag(rateParticles[k], ParticleFlags::Waiting);
+				}
+			}
+		});
 	}
-	else
+	threadPool.WaitForCompletion();
+}
+
+std::span<const uint32_t> VerletSolver::ActiveParticles() const
+{
+	if(!multiRateActive)
 	{
-		local = Vector2::Rotate(toPos, -s.rectRotation);
-		if(std::fabs(local.x) > halfRectSize.x || std::fabs(local.y) > halfRectSize.y)
-		{
-			return Vector2::zero;
-		}
+		return movingParticles;
 	}
+	return std::span<const uint32_t>(rateParticles.data(), rateKeyStarts[(activeRateShift + 1u) * 2u]);
+}
 
-	Vector2 dir;
-	if(s.direction == ForceFieldDirection::FromCenter)
+void VerletSolver::ResetRates()
+{
+	for(const auto& [offset, amount] : ThreadPool::SplitWork(particles.Size(), threadPool.ThreadCount()))
 	{
-		float len = toPos.SqrLength();
-		if(len < eps)
+		if(amount == 0)
 		{
-			return Vector2::zero;
+			continue;
 		}
-		dir = toPos / std::sqrtf(len);
+
+		threadPool.EnqueueJob([this, offset, amount]
+		{
+			for(size_t i = offset; i < offset + amount; i++)
+			{
+				if(particles.rateShift[i] == 0)
+				{
+					continue;
+				}
+				const float scale = std::ldexp(1.0f, -static_cast<int>(particles.rateShift[i]));
+				particles.prevX[i] = particles.posX[i] - (particles.posX[i] - particles.prevX[i]) * scale;
+				particles.prevY[i] = particles.posY[i] - (particles.posY[i] - particles.prevY[i]) * scale;
+				particles.rateShift[i] = 0;
+			}
+		});
 	}
-	else
+	threadPool.WaitForCompletion();
+}
+
+void VerletSolver::Collisions()
+{
+	broadPhaseCounter.BeginSubFrame();
+	collisionSteps++;
+	//With neighbor lists the grid is only needed to track sleeping cells and cell rates and to find the particles in the way of fast ones
+	if(!neighborLists || sleeping || continuousCollision || multiRateActive)
 	{
-		dir = s.DirVector();
-		if(s.shape == ForceFieldShape::Rect)
+		if(assignedStorageVersion != particles.Version())
+		{
+			partitioning.AssignLevels(particles.radius.data(), particles.flags.data(), static_cast<uint8_t>(ParticleFlags::Pinned), particles.Size());
+			assignedStorageVersion = particles.Version();
+		}
+		//Rates are assigned from a full grid at the start of a step, later substeps only bin the particles taking them
+		//and the waiting ones in the cells bordering theirs, all other particles are at least a cell away
+		if(multiRateActive && substep > 0)
+		{
+			UpdateWaiting();
+			const size_t binned = rateKeyStarts[std::min<size_t>((activeRateShift + 1u) * 2u + 1u, rateKeyStarts.size() - 1)];
+			partitioning.Build(particles.posX.data(), particles.posY.data(), rateParticles.data(), binned, threadPool);
+		}
+		else
 		{
-			dir = Vector2::Rotate(dir, s.rectRotation);
+			partitioning.Build(particles.posX.data(), particles.posY.data(), threadPool);
+			if(multiRateActive)
+			{
+				AssignRates();
+				SortByRate();
+				UpdateWaiting();
+			}
+		}
+		if(sleeping || multiRateActive)
+		{
+			UpdateCellStates();
 		}
 	}
+	if(neighborLists && NeighborListsStale())
+	{
+		BuildNeighborLists();
+	}
+	broadPhaseCounter.EndSubFrame();
 
-	float falloff = 1.0f;
-	if(s.falloff != ForceFieldFalloff::None)
+	narrowPhaseCounter.BeginSubFrame();
+	//Further passes reuse the grid of the first one, particles only moved by the corrections in between
+	//The overlaps a pass finds are what the previous one left, so the iterations end once a pass finds next to nothing
+	const uint32_t passes = adaptiveIterations ? std::max(maxIterations, 1u) : 1;
+	if(adaptiveIterations)
+	{
+		unresolvedCells.resize(partitioning.Level(0).CellCount());
+		nextUnresolvedCells.resize(partitioning.Level(0).CellCount());
+	}
+	for(collisionPass = 0; collisionPass < passes; collisionPass++)
 	{
-		if(s.shape == ForceFieldShape::Circle)
+		if(adaptiveIterations)
 		{
-			falloff = 1.0f - toPos.Length() / std::max(s.range, eps);
+			std::fill(nextUnresolvedCells.begin(), nextUnresolvedCells.end(), 0);
 		}
-		else
+		CollisionPass();
+		if(passMaxPenetration.load() <= overlapTolerance)
 		{
-			const float mx = 1.0f - std::fabs(local.x) / std::max(halfRectSize.x, eps);
-			const float my = 1.0f - std::fabs(local.y) / std::max(halfRectSize.y, eps);
-			falloff = std::fminf(mx, my);
+			break;
 		}
-		falloff = s.ApplyFalloff(std::clamp(falloff, 0.0f, 1.0f));
+		std::swap(unresolvedCells, nextUnresolvedCells);
 	}
-
-	float mag = s.massDependent ? (s.force * falloff * (1.0f / particle.mass)) : (s.force * falloff);
-	return dir * mag;
+	narrowPhaseCounter.EndSubFrame();
 }
 
-void VerletSolver::CollectStats()
+void VerletSolver::CollisionPass()
 {
-	broadPhaseCounter.EndFrame();
-	narrowPhaseCounter.EndFrame();
-	updatePhaseCounter.EndFrame();
-	linkPhaseCounter.EndFrame();
-}
+	passMaxPenetration = 0.0f;
+	passPenetrationSum = 0.0;
+	passContacts = 0;
+	if(collisionMode == SolverCollisionMode::Jacobi)
+	{
+		JacobiCollisions();
+	}
+	else if(neighborLists)
+	{
+		SolveNeighborLists();
+	}
+	else
+	{
+		GaussSeidelCollisions();
+	}
+	collisionPasses++;
 
-const FrameCounter& VerletSolver::BroadPhaseCounter() const
-{
-	return broadPhaseCounter;
+	const uint64_t overlapping = passContacts.load();
+	lastMaxPenetration = passMaxPenetration.load();
+	lastMeanPenetration = overlapping > 0 ? static_cast<float>(passPenetrationSum.load() / static_cast<double>(overlapping)) : 0.0f;
 }
 
-const FrameCounter& VerletSolver::NarrowPhaseCounter() const
+void VerletSolver::MergePenetration(float maxPenetration, double penetrationSum, uint64_t overlapping)
 {
-	return narrowPhaseCounter;
+	float current = passMaxPenetration.load();
+	while(current < maxPenetration && !passMaxPenetration.compare_exchange_weak(current, maxPenetration));
+	passPenetrationSum += penetrationSum;
+	passContacts += overlapping;
 }
 
-const FrameCounter& VerletSolver::UpdatePhaseCounter() const
+void VerletSolver::GaussSeidelCollisions()
 {
-	return updatePhaseCounter;
-}
-
-const FrameCounter& VerletSolver::LinkPhaseCounter() const
+	//Solving a column also writes to particles of the next column, so columns are grouped into stripes and
+	//even and odd stripes are solved in separate passes. Stripes of the same pass never touch the same cells
+	//Stripes are made of columns of the coarsest level, the columns of finer levels nest inside of them
+	//Stripes of one pass don't share any particles either, so with a fixed width the result doesn't depend on the thread count
+	const int32_t cellsX = partitioning.Level(0).CellsX();
+	const uint32_t threadCount = threadPool.ThreadCount();
+	const int32_t stripeWidth = deterministic ? minStripeWidth : std::max(minStripeWidth, cellsX / static_cast<int32_t>(threadCount * 2));
+	const int32_t stripes = (cellsX + stripeWidth - 1) / stripeWidth;
+	for(int32_t pass = 0; pass < 2; pass++)
+	{
+		const int32_t passStripes = (stripes - pass + 1) / 2;
+		for(const auto& [offset, amount] : ThreadPool::SplitWork(passStripes, threadCount))
+		{
+			if(amount == 0)
+			{
+				continue;
+			}
+
+			threadPool.EnqueueJob([this, offset, amount, pass, stripeWidth, cellsX]
+			{
+				NarrowPhase::PackedCell packed = {};
+				packed.tolerance = adaptiveIterations ? overlapTolerance : packed.tolerance;
+				for(size_t i = offset; i < offset + amount; i++)
+				{
+					const int32_t stripe = static_cast<int32_t>(i) * 2 + pass;
+					const int32_t begin = stripe * stripeWidth;
+					const int32_t end = std::min((stripe + 1) * stripeWidth, cellsX);
+					for(uint32_t level = 0; level < partitioning.LevelCount(); level++)
+					{
+						if(partitioning.Level(level).Size() == 0)
+						{
+							continue;
+						}
+
+						SolveColumns(level, begin << level, end << level, packed);
+						for(uint32_t coarse = 0; coarse < level; coarse++)
+						{
+							if(partitioning.Level(coarse).Size() > 0)
+							{
+								SolveLevels(level, coarse, begin << level, end << level, packed);
+							}
+						}
+					}
+				}
+				pairTests += packed.tests;
+				MergePenetration(packed.maxPenetration, packed.penetrationSum, packed.contacts);
+			});
+		}
+		threadPool.WaitForCompletion();
+	}
+}
+
+void VerletSolver::JacobiCollisions()
+{
+	//Every particle only sums up its own corrections while positions stay untouched, so no two jobs write the same data
+	//and the sums are taken in grid order regardless of how the columns are split between threads
+	deltaX.assign(particles.Size(), 0.0f);
+	deltaY.assign(particles.Size(), 0.0f);
+	contacts.assign(particles.Size(), 0);
+	if(multiRateActive)
+	{
+		prevDeltaX.assign(particles.Size(), 0.0f);
+		prevDeltaY.assign(particles.Size(), 0.0f);
+	}
+	if(neighborLists)
+	{
+		SolveNeighborLists();
+	}
+	else
+	{
+		const int32_t cellsX = partitioning.Level(0).CellsX();
+		for(const auto& [offset, amount] : ThreadPool::SplitWork(cellsX, threadPool.ThreadCount()))
+		{
+			if(amount == 0)
+			{
+				continue;
+			}
+
+			threadPool.EnqueueJob([this, offset, amount]
+			{
+				NarrowPhase::PackedCell packed = {};
+				packed.tolerance = adaptiveIterations ? overlapTolerance : packed.tolerance;
+				const int32_t begin = static_cast<int32_t>(offset);
+				const int32_t end = static_cast<int32_t>(offset + amount);
+				for(uint32_t level = 0; level < partitioning.LevelCount(); level++)
+				{
+					if(partitioning.Level(level).Size() > 0)
+					{
+						AccumulateColumns(level, begin << level, end << level, packed);
+					}
+				}
+				pairTests += packed.tests;
+				MergePenetration(packed.maxPenetration, packed.penetrationSum, packed.contacts);
+			});
+		}
+		threadPool.WaitForCompletion();
+	}
+
+	for(const auto& [offset, amount] : ThreadPool::SplitWork(particles.Size(), threadPool.ThreadCount()))
+	{
+		if(amount == 0)
+		{
+			continue;
+		}
+
+		threadPool.EnqueueJob([this, offset, amount]
+		{
+			for(size_t i = offset; i < offset + amount; i++)
+			{
+				if(contacts[i] > 0)
+				{
+					const float scale = relaxation / static_cast<float>(contacts[i]);
+					particles.posX[i] += deltaX[i] * scale;
+					particles.posY[i] += deltaY[i] * scale;
+					if(multiRateActive)
+					{
+						particles.prevX[i] += prevDeltaX[i] * scale;
+						particles.prevY[i] += prevDeltaY[i] * scale;
+					}
+				}
+			}
+		});
+	}
+	threadPool.WaitForCompletion();
+}
+
+void VerletSolver::UpdateCellStates()
+{
+	//Only the cells flagged by the last pass are cleared, so substeps binning a few particles don't touch the whole grid
+	if(cellStates.size() != partitioning.CellCount())
+	{
+		cellStates.assign(partitioning.CellCount(), 0);
+		cellMoving.assign(partitioning.CellCount(), 0);
+		jobFlaggedCells.clear();
+	}
+	for(std::vector<uint32_t>& flagged : jobFlaggedCells)
+	{
+		for(uint32_t cell : flagged)
+		{
+			cellStates[cell] = 0;
+			cellMoving[cell] = 0;
+		}
+		flagged.clear();
+	}
+	const uint32_t cellsX = static_cast<uint32_t>(partitioning.Level(0).CellsX());
+
+	//Both passes only take a few microseconds for small scenes, far less than dispatching them
+	if(particles.Size() < parallelSleepThreshold)
+	{
+		jobFlaggedCells.resize(std::max<size_t>(jobFlaggedCells.size(), 1));
+		FlagCells(0, cellsX, jobFlaggedCells[0]);
+		if(sleeping)
+		{
+			WakeCells(0, cellsX);
+		}
+		return;
+	}
+
+	const std::vector<std::pair<size_t, size_t>> columns = ThreadPool::SplitWork(cellsX, threadPool.ThreadCount());
+	jobFlaggedCells.resize(std::max(jobFlaggedCells.size(), columns.size()));
+	for(size_t job = 0; job < columns.size(); job++)
+	{
+		threadPool.EnqueueJob([this, job, offset = columns[job].first, amount = columns[job].second]
+		{
+			FlagCells(static_cast<uint32_t>(offset), static_cast<uint32_t>(offset + amount), jobFlaggedCells[job]);
+		});
+	}
+	threadPool.WaitForCompletion();
+	if(!sleeping)
+	{
+		return;
+	}
+
+	for(const auto& [offset, amount] : columns)
+	{
+		threadPool.EnqueueJob([this, offset, amount] { WakeCells(static_cast<uint32_t>(offset), static_cast<uint32_t>(offset + amount)); });
+	}
+	threadPool.WaitForCompletion();
+}
+
+void VerletSolver::FlagCells(uint32_t beginColumn, uint32_t endColumn, std::vector<uint32_t>& flagged)
+{
+	const bool waitingAwake = collisionMode == SolverCollisionMode::Jacobi && !neighborLists;
+	for(uint32_t level = 0; level < partitioning.LevelCount(); level++)
+	{
+		const PartitioningGrid& grid = partitioning.Level(level);
+		const uint32_t cellsY = static_cast<uint32_t>(grid.CellsY());
+		grid.ForEachCell((beginColumn << level) * cellsY, (endColumn << level) * cellsY, [&](uint32_t cell, PartitioningCell cellParticles)
+		{
+			uint8_t state = 0;
+			bool moving = false;
+			for(uint32_t i : cellParticles)
+			{
+				//Jacobi only moves the particles of awake cells, so waiting particles next to the ones taking the substep gather their share themselves
+				state |= !particles.IsResting(i) || (waitingAwake && particles.HasFlag(i, ParticleFlags::Waiting)) ? CellAwake : 0;
+				state |= particles.HasFlag(i, ParticleFlags::Sleeping) ? CellSleeping : 0;
+				moving |= particles.HasFlag(i, ParticleFlags::Moving);
+			}
+			cellStates[partitioning.CellOffset(level) + cell] = state;
+			flagged.push_back(partitioning.CellOffset(level) + cell);
+			if(!moving)
+			{
+				return;
+			}
+
+			//Moving particles are also marked in the ancestors of their cell, so sleeping particles of coarser levels notice them
+			const uint32_t x = cell / cellsY;
+			const uint32_t y = cell % cellsY;
+			for(uint32_t l = 0; l <= level; l++)
+			{
+				const uint32_t lCellsY = static_cast<uint32_t>(partitioning.Level(l).CellsY());
+				const uint32_t ancestor = partitioning.CellOffset(l) + (x >> (level - l)) * lCellsY + (y >> (level - l));
+				if(cellMoving[ancestor] == 0 && l < level)
+				{
+					flagged.push_back(ancestor);
+				}
+				cellMoving[ancestor] = 1;
+			}
+		});
+	}
+}
+
+void VerletSolver::WakeCells(uint32_t beginColumn, uint32_t endColumn)
+{
+	//Sleeping particles wake up when anything in their own or a neighboring cell moves fast enough,
+	//this also catches particles losing their support
+	for(uint32_t level = 0; level < partitioning.LevelCount(); level++)
+	{
+		const PartitioningGrid& grid = partitioning.Level(level);
+		const uint32_t offset = partitioning.CellOffset(level);
+		const int32_t cellsY = grid.CellsY();
+		grid.ForEachCell((beginColumn << level) * cellsY, (endColumn << level) * cellsY, [&](uint32_t cell, PartitioningCell cellParticles)
+		{
+			if((cellStates[offset + cell] & CellSleeping) == 0)
+			{
+				return;
+			}
+
+			const int32_t x = static_cast<int32_t>(cell) / cellsY;
+			const int32_t y = static_cast<int32_t>(cell) % cellsY;
+			bool disturbed = false;
+			for(uint32_t l = 0; l <= level && !disturbed; l++)
+			{
+				const PartitioningGrid& lGrid = partitioning.Level(l);
+				const uint32_t lOffset = partitioning.CellOffset(l);
+				const int32_t lCellsY = lGrid.CellsY();
+				const int32_t lx = x >> (level - l);
+				const int32_t ly = y >> (level - l);
+				for(int32_t nx = std::max(lx - 1, 0); nx <= std::min(lx + 1, lGrid.CellsX() - 1) && !disturbed; nx++)
+				{
+					for(int32_t ny = std::max(ly - 1, 0); ny <= std::min(ly + 1, lCellsY - 1) && !disturbed; ny++)
+					{
+						disturbed = cellMoving[lOffset + nx * lCellsY + ny] != 0;
+					}
+				}
+			}
+			if(!disturbed)
+			{
+				return;
+			}
+
+			for(uint32_t i : cellParticles)
+			{
+				if(particles.HasFlag(i, ParticleFlags::Sleeping))
+				{
+					particles.Wake(i);
+				}
+			}
+			cellStates[offset + cell] = CellAwake;
+		});
+	}
+}
+
+bool VerletSolver::IsCellAwake(uint32_t cell) const
+{
+	return !(sleeping || multiRateActive) || (cellStates[cell] & CellAwake) != 0;
+}
+
+bool VerletSolver::IsCellUnresolved(uint32_t level, int32_t x, int32_t y) const
+{
+	if(collisionPass == 0)
+	{
+		return true;
+	}
+
+	//Corrections of the last pass can push particles into the neighboring cells as well
+	const PartitioningGrid& grid = partitioning.Level(0);
+	const int32_t cellsY = grid.CellsY();
+	x >>= level;
+	y >>= level;
+	for(int32_t nx = std::max(x - 1, 0); nx <= std::min(x + 1, grid.CellsX() - 1); nx++)
+	{
+		for(int32_t ny = std::max(y - 1, 0); ny <= std::min(y + 1, cellsY - 1); ny++)
+		{
+			if(unresolvedCells[nx * cellsY + ny] != 0)
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void VerletSolver::MarkUnresolved(uint32_t level, int32_t x, int32_t y)
+{
+	//Jobs only solve home cells of their own columns, so they never write the same entry
+	nextUnresolvedCells[(x >> level) * partitioning.Level(0).CellsY() + (y >> level)] = 1;
+}
+
+void VerletSolver::SolveColumns(uint32_t level, int32_t begin, int32_t end, NarrowPhase::PackedCell& packed)
+{
+	static const std::array<std::pair<int32_t, int32_t>, 4> cellOffsets =
+	{
+		std::make_pair(1, 1),
+		std::make_pair(1, 0),
+		std::make_pair(1, -1),
+		std::make_pair(0, -1)
+	};
+	const PartitioningGrid& grid = partitioning.Level(level);
+	const PartitioningGrid& staticLayer = partitioning.StaticLayer();
+	const uint32_t offset = partitioning.CellOffset(level);
+	const int32_t cellsY = grid.CellsY();
+	const int32_t lastXCell = grid.CellsX() - 1;
+	const int32_t lastYCell = cellsY - 1;
+	const int32_t staticCellsY = staticLayer.CellsY();
+	const bool hasStatic = staticLayer.Size() > 0;
+
+	grid.ForEachCell(begin * cellsY, end * cellsY, [&](uint32_t home, PartitioningCell cell)
+	{
+		const int32_t i = static_cast<int32_t>(home) / cellsY;
+		const int32_t k = static_cast<int32_t>(home) % cellsY;
+		if(!IsCellUnresolved(level, i, k))
+		{
+			return;
+		}
+		const uint64_t unresolved = packed.unresolved;
+
+		//Pairs between two cells without any awake particle are skipped
+		const bool homeAwake = IsCellAwake(offset + home);
+		bool isPacked = false;
+		if(homeAwake)
+		{
+			packed.Pack(particles, cell.data(), cell.size());
+			isPacked = true;
+			SolveCell(packed);
+		}
+
+		for(const auto& [xOff, yOff] : cellOffsets)
+		{
+			int32_t x = i + xOff;
+			int32_t y = k + yOff;
+			if(((static_cast<uint32_t>(x) > lastXCell) | (static_cast<uint32_t>(y) > lastYCell)) != 0)
+			{
+				continue;
+			}
+
+			const uint32_t neighbor = x * cellsY + y;
+			const PartitioningCell neighborCell = grid.At(neighbor);
+			if(neighborCell.empty() || (!homeAwake && !IsCellAwake(offset + neighbor)))
+			{
+				continue;
+			}
+			if(!isPacked)
+			{
+				packed.Pack(particles, cell.data(), cell.size());
+				isPacked = true;
+			}
+			SolveCells(neighborCell, packed);
+		}
+
+		//Static particles are never in a home cell, so every cell tests the 3x3 cells of the static layer around its ancestor
+		const int32_t sx = i >> level;
+		const int32_t sy = k >> level;
+		if(homeAwake && hasStatic && partitioning.NearStatic(sx * staticCellsY + sy))
+		{
+			for(int32_t x = std::max(sx - 1, 0); x < std::min(sx + 2, staticLayer.CellsX()); x++)
+			{
+				for(int32_t y = std::max(sy - 1, 0); y < std::min(sy + 2, staticCellsY); y++)
+				{
+					const PartitioningCell staticCell = staticLayer.At(x, y);
+					if(!staticCell.empty())
+					{
+						SolveCells(staticCell, packed);
+					}
+				}
+			}
+		}
+
+		if(packed.unresolved != unresolved)
+		{
+			MarkUnresolved(level, i, k);
+		}
+	});
+}
+
+void VerletSolver::SolveLevels(uint32_t level, uint32_t coarse, int32_t begin, int32_t end, NarrowPhase::PackedCell& packed)
+{
+	//Particles of coarser levels are at most as large as the cells of their level,
+	//so all of them touching a cell are in the 3x3 cells around its ancestor on their level
+	//Those are packed once for all cells of the column sharing the same ancestor
+	const PartitioningGrid& grid = partitioning.Level(level);
+	const PartitioningGrid& coarseGrid = partitioning.Level(coarse);
+	const uint32_t offset = partitioning.CellOffset(level);
+	const uint32_t coarseOffset = partitioning.CellOffset(coarse);
+	const uint32_t shift = level - coarse;
+	const int32_t cellsY = grid.CellsY();
+	const int32_t coarseCellsY = coarseGrid.CellsY();
+	const int32_t lastCoarseX = coarseGrid.CellsX() - 1;
+
+	for(int32_t x = begin; x < end; x++)
+	{
+		const int32_t px = x >> shift;
+		int32_t packedY = -1;
+		bool coarseAwake = false;
+		grid.ForEachCell(x * cellsY, (x + 1) * cellsY, [&](uint32_t home, PartitioningCell cell)
+		{
+			const int32_t py = (static_cast<int32_t>(home) % cellsY) >> shift;
+			if(py != packedY)
+			{
+				packedY = py;
+				const uint32_t y0 = static_cast<uint32_t>(std::max(py - 1, 0));
+				const uint32_t y1 = static_cast<uint32_t>(std::min(py + 2, coarseCellsY));
+				auto column = [&](int32_t cx)
+				{
+					return cx < 0 || cx > lastCoarseX ? PartitioningCell() : coarseGrid.Range(cx * coarseCellsY + y0, cx * coarseCellsY + y1);
+				};
+				const PartitioningCell left = column(px - 1);
+				const PartitioningCell center = column(px);
+				const PartitioningCell right = column(px + 1);
+				if(left.empty() && center.empty() && right.empty())
+				{
+					packed.count = 0;
+					return;
+				}
+				packed.Pack(particles, { left, center, right });
+
+				coarseAwake = !sleeping;
+				for(int32_t cx = std::max(px - 1, 0); cx <= std::min(px + 1, lastCoarseX) && !coarseAwake; cx++)
+				{
+					for(uint32_t cy = y0; cy < y1 && !coarseAwake; cy++)
+					{
+						coarseAwake = IsCellAwake(coarseOffset + cx * coarseCellsY + cy);
+					}
+				}
+			}
+
+			const int32_t y = static_cast<int32_t>(home) % cellsY;
+			if(packed.count > 0 && (coarseAwake || IsCellAwake(offset + home)) && IsCellUnresolved(level, x, y))
+			{
+				const uint64_t unresolved = packed.unresolved;
+				SolveCells(cell, packed);
+				if(packed.unresolved != unresolved)
+				{
+					MarkUnresolved(level, x, y);
+				}
+			}
+		});
+	}
+}
+
+void VerletSolver::AccumulateColumns(uint32_t level, int32_t begin, int32_t end, NarrowPhase::PackedCell& packed)
+{
+	//Each cell gathers the 3x3 cells around it on its own level, around its ancestor on coarser levels
+	//and all children of its 3x3 cells on finer levels, which finds every pair from both sides
+	const PartitioningGrid& grid = partitioning.Level(level);
+	const uint32_t offset = partitioning.CellOffset(level);
+	const int32_t cellsY = grid.CellsY();
+	grid.ForEachCell(begin * cellsY, end * cellsY, [&](uint32_t home, PartitioningCell cell)
+	{
+		const int32_t x = static_cast<int32_t>(home) / cellsY;
+		const int32_t y = static_cast<int32_t>(home) % cellsY;
+		if(!IsCellAwake(offset + home) || !IsCellUnresolved(level, x, y))
+		{
+			return;
+		}
+		packed.gathered.clear();
+		//Static particles don't gather anything themselves, they only show up in the cells of moving ones
+		const PartitioningGrid& staticLayer = partitioning.StaticLayer();
+		const int32_t sx = x >> level;
+		const int32_t sy = y >> level;
+		const int32_t sCellsY = staticLayer.CellsY();
+		if(staticLayer.Size() > 0 && partitioning.NearStatic(sx * sCellsY + sy))
+		{
+			const int32_t y0 = std::max(sy - 1, 0);
+			const int32_t y1 = std::min(sy + 2, sCellsY);
+			for(int32_t cx = std::max(sx - 1, 0); cx < std::min(sx + 2, staticLayer.CellsX()); cx++)
+			{
+				const PartitioningCell column = staticLayer.Range(cx * sCellsY + y0, cx * sCellsY + y1);
+				packed.gathered.insert(packed.gathered.end(), column.begin(), column.end());
+			}
+		}
+		for(uint32_t l = 0; l < partitioning.LevelCount(); l++)
+		{
+			const PartitioningGrid& lGrid = partitioning.Level(l);
+			if(lGrid.Size() == 0)
+			{
+				continue;
+			}
+
+			int32_t x0, x1, y0, y1;
+			if(l <= level)
+			{
+				const uint32_t shift = level - l;
+				x0 = (x >> shift) - 1;
+				x1 = (x >> shift) + 2;
+				y0 = (y >> shift) - 1;
+				y1 = (y >> shift) + 2;
+			}
+			else
+			{
+				const uint32_t shift = l - level;
+				x0 = (x - 1) << shift;
+				x1 = (x + 2) << shift;
+				y0 = (y - 1) << shift;
+				y1 = (y + 2) << shift;
+			}
+			const int32_t lCellsY = lGrid.CellsY();
+			y0 = std::max(y0, 0);
+			y1 = std::min(y1, lCellsY);
+			for(int32_t cx = std::max(x0, 0); cx < std::min(x1, lGrid.CellsX()); cx++)
+			{
+				const PartitioningCell column = lGrid.Range(cx * lCellsY + y0, cx * lCellsY + y1);
+				packed.gathered.insert(packed.gathered.end(), column.begin(), column.end());
+			}
+		}
+		if(packed.gathered.empty())
+		{
+			return;
+		}
+
+		packed.Pack(particles, packed.gathered.data(), packed.gathered.size());
+		packed.tests += cell.size() * packed.count;
+		const uint64_t unresolved = packed.unresolved;
+		NarrowPhase::SolveCells(simdLevel, particles, cell.data(), cell.size(), packed, [this, &packed](uint32_t a, uint32_t b) { packed.AddPenetration(Accumulate(a, b)); });
+		if(packed.unresolved != unresolved)
+		{
+			MarkUnresolved(level, x, y);
+		}
+	});
+}
+
+bool VerletSolver::NeighborListsStale() const
+{
+	//Two particles which both moved less than half the skin can't have gotten closer than the skin allows for
+	const float maxDst = neighborSkin * 0.5f;
+	return neighborStorageVersion != particles.Version() || maxSqrListTravel.load() > maxDst * maxDst;
+}
+
+float VerletSolver::ListTravel(uint32_t index, Vector2 pos) const
+{
+	const float dx = pos.x - neighborX[index];
+	const float dy = pos.y - neighborY[index];
+	return dx * dx + dy * dy;
+}
+
+void VerletSolver::MergeListTravel(float sqrTravel)
+{
+	float current = maxSqrListTravel.load();
+	while(current < sqrTravel && !maxSqrListTravel.compare_exchange_weak(current, sqrTravel));
+}
+
+void VerletSolver::BuildNeighborLists()
+{
+	static const std::array<std::pair<int32_t, int32_t>, 4> cellOffsets =
+	{
+		std::make_pair(1, 1),
+		std::make_pair(1, 0),
+		std::make_pair(1, -1),
+		std::make_pair(0, -1)
+	};
+
+	//All pairs within reach are in neighboring cells as long as the cells fit the largest particles and the skin,
+	//so the cell count is rounded down
+	//Levels are assigned by the radii grown by half the skin, which makes the cells of a level fit the reach of its particles as well
+	const float cellSize = partitioningTuner.MinCellSize() + neighborSkin;
+	const auto [min, max] = constraint.Bounds();
+	const int32_t requiredX = std::max(static_cast<int32_t>((max - min).x / cellSize), 1);
+	const int32_t requiredY = std::max(static_cast<int32_t>((max - min).y / cellSize), 1);
+	const uint32_t levelCount = partitioning.LevelCount();
+	if(!neighborGrid || neighborGrid->Level(0).CellsX() != requiredX || neighborGrid->Level(0).CellsY() != requiredY || neighborGrid->LevelCount() != levelCount)
+	{
+		neighborGrid.emplace(min, max, requiredX, requiredY, levelCount);
+	}
+	neighborRadii.resize(particles.Size());
+	for(size_t i = 0; i < particles.Size(); i++)
+	{
+		neighborRadii[i] = particles.radius[i] + neighborSkin * 0.5f;
+	}
+	neighborGrid->AssignLevels(neighborRadii.data(), particles.flags.data(), 0, particles.Size());
+	const HierarchicalGrid& grid = neighborGrid.value();
+	neighborGrid->Build(particles.posX.data(), particles.posY.data(), threadPool);
+
+	const int32_t cellsX = grid.Level(0).CellsX();
+	const uint32_t threadCount = threadPool.ThreadCount();
+	//Blocked substeps need many narrow stripes to split the work into tiles
+	//Jacobi sums the corrections of a particle in list order, which would otherwise follow the thread count
+	const bool fixedStripes = deterministic || temporalBlocking || collisionMode == SolverCollisionMode::Jacobi;
+	const int32_t stripeWidth = fixedStripes ? minStripeWidth : std::max(minStripeWidth, cellsX / static_cast<int32_t>(threadCount * 2));
+	neighborPairs.resize((cellsX + stripeWidth - 1) / stripeWidth);
+	neighborStripeParticles.resize(neighborPairs.size());
+	neighborStripeWidth = stripeWidth;
+	for(const auto& [offset, amount] : ThreadPool::SplitWork(neighborPairs.size(), threadCount))
+	{
+		if(amount == 0)
+		{
+			continue;
+		}
+
+		threadPool.EnqueueJob([this, &grid, offset, amount, stripeWidth, cellsX]
+		{
+			const float skin = neighborSkin;
+			auto addPair = [&](std::vector<std::pair<uint32_t, uint32_t>>& pairs, uint32_t a, uint32_t b)
+			{
+				//Pinned particles never need to be separated from each other
+				if(particles.HasFlag(a, ParticleFlags::Pinned) && particles.HasFlag(b, ParticleFlags::Pinned))
+				{
+					return;
+				}
+
+				const float reach = particles.radius[a] + particles.radius[b] + skin;
+				if((particles.Position(a) - particles.Position(b)).SqrLength() < reach * reach)
+				{
+					pairs.emplace_back(a, b);
+				}
+			};
+
+			for(size_t stripe = offset; stripe < offset + amount; stripe++)
+			{
+				std::vector<std::pair<uint32_t, uint32_t>>& pairs = neighborPairs[stripe];
+				pairs.clear();
+				const int32_t begin = static_cast<int32_t>(stripe) * stripeWidth;
+				const int32_t end = std::min(begin + stripeWidth, cellsX);
+				auto stripeOf = [stripeWidth](int32_t column) { return column / stripeWidth; };
+				for(uint32_t level = 0; level < grid.LevelCount(); level++)
+				{
+					const PartitioningGrid& levelGrid = grid.Level(level);
+					const int32_t levelCellsX = levelGrid.CellsX();
+					const int32_t levelCellsY = levelGrid.CellsY();
+					levelGrid.ForEachCell((begin << level) * levelCellsY, (end << level) * levelCellsY, [&](uint32_t home, PartitioningCell cell)
+					{
+						const int32_t i = static_cast<int32_t>(home) / levelCellsY;
+						const int32_t k = static_cast<int32_t>(home) % levelCellsY;
+						for(size_t a = 0; a < cell.size(); a++)
+						{
+							for(size_t b = a + 1; b < cell.size(); b++)
+							{
+								addPair(pairs, cell[a], cell[b]);
+							}
+						}
+
+						for(const auto& [xOff, yOff] : cellOffsets)
+						{
+							int32_t x = i + xOff;
+							int32_t y = k + yOff;
+							if(x >= levelCellsX || y < 0 || y >= levelCellsY)
+							{
+								continue;
+							}
+
+							for(uint32_t b : levelGrid.At(x, y))
+							{
+								for(uint32_t a : cell)
+								{
+									addPair(pairs, a, b);
+								}
+							}
+						}
+					});
+
+					//Particles of coarser levels reaching a particle are in the 3x3 cells around its ancestor on their level,
+					//such a pair belongs to the left one of the stripes of the two cells, which is at most one column of the coarsest level away
+					for(uint32_t coarse = 0; coarse < level; coarse++)
+					{
+						const PartitioningGrid& coarseGrid = grid.Level(coarse);
+						const uint32_t shift = level - coarse;
+						const int32_t coarseCellsY = coarseGrid.CellsY();
+						const int32_t lastCoarseX = coarseGrid.CellsX() - 1;
+						const int32_t lastColumn = std::min(end + 1, cellsX);
+						levelGrid.ForEachCell((begin << level) * levelCellsY, (lastColumn << level) * levelCellsY, [&](uint32_t home, PartitioningCell cell)
+						{
+							const int32_t x = static_cast<int32_t>(home) / levelCellsY;
+							const int32_t px = x >> shift;
+							const int32_t py = (static_cast<int32_t>(home) % levelCellsY) >> shift;
+							const int32_t homeStripe = stripeOf(x >> level);
+							const int32_t y0 = std::max(py - 1, 0);
+							const int32_t y1 = std::min(py + 2, coarseCellsY);
+							for(int32_t cx = std::max(px - 1, 0); cx <= std::min(px + 1, lastCoarseX); cx++)
+							{
+								if(std::min(homeStripe, stripeOf(cx >> coarse)) != static_cast<int32_t>(stripe))
+								{
+									continue;
+								}
+
+								for(uint32_t b : coarseGrid.Range(cx * coarseCellsY + y0, cx * coarseCellsY + y1))
+								{
+									for(uint32_t a : cell)
+									{
+										addPair(pairs, a, b);
+									}
+								}
+							}
+						});
+					}
+				}
+
+				std::vector<uint32_t>& moving = neighborStripeParticles[stripe];
+				moving.clear();
+				for(uint32_t level = 0; level < grid.LevelCount(); level++)
+				{
+					const PartitioningGrid& levelGrid = grid.Level(level);
+					const uint32_t levelCellsY = static_cast<uint32_t>(levelGrid.CellsY());
+					for(uint32_t p : levelGrid.Range(static_cast<uint32_t>(begin << level) * levelCellsY, static_cast<uint32_t>(end << level) * levelCellsY))
+					{
+						if(!particles.HasFlag(p, ParticleFlags::Pinned))
+						{
+							moving.push_back(p);
+						}
+					}
+				}
+			}
+		});
+	}
+	threadPool.WaitForCompletion();
+
+	neighborX = particles.posX;
+	neighborY = particles.posY;
+	neighborStorageVersion = particles.Version();
+	maxSqrListTravel = 0.0f;
+	neighborListBuilds++;
+}
+
+void VerletSolver::SolveNeighborLists()
+{
+	//Same two passes over even and odd stripes as the grid, Jacobi mode accumulates both sides of a pair at once
+	const bool jacobi = collisionMode == SolverCollisionMode::Jacobi;
+	const size_t stripes = neighborPairs.size();
+	for(size_t pass = 0; pass < 2; pass++)
+	{
+		const size_t passStripes = (stripes - pass + 1) / 2;
+		for(const auto& [offset, amount] : ThreadPool::SplitWork(passStripes, threadPool.ThreadCount()))
+		{
+			if(amount == 0)
+			{
+				continue;
+			}
+
+			threadPool.EnqueueJob([this, offset, amount, pass, jacobi]
+			{
+				uint64_t tests = 0;
+				float maxPenetration = 0.0f;
+				double penetrationSum = 0.0;
+				uint64_t overlapping = 0;
+				for(size_t i = offset; i < offset + amount; i++)
+				{
+					const std::vector<std::pair<uint32_t, uint32_t>>& pairs = neighborPairs[i * 2 + pass];
+					for(const auto& [a, b] : pairs)
+					{
+						float penetration;
+						if(jacobi)
+						{
+							penetration = Accumulate(a, b);
+							Accumulate(b, a);
+						}
+						else
+						{
+							penetration = Solve(a, b);
+						}
+						if(penetration > 0.0f)
+						{
+							maxPenetration = std::max(maxPenetration, penetration);
+							penetrationSum += penetration;
+							overlapping++;
+						}
+					}
+					tests += pairs.size();
+				}
+				pairTests += tests;
+				MergePenetration(maxPenetration, penetrationSum, overlapping);
+			});
+		}
+		threadPool.WaitForCompletion();
+	}
+}
+
+uint32_t VerletSolver::BlockLength(uint32_t remaining) const
+{
+	//Blocks reorder the work of the regular substeps, which only works as long as nothing in a substep needs the whole scene at once
+	if(!temporalBlocking || !collision || !neighborLists || collisionMode != SolverCollisionMode::GaussSeidel || !links.empty()
+		|| sleeping || multiRateActive || continuousCollision || adaptiveIterations || !neighborGrid)
+	{
+		return 1;
+	}
+	//Smaller scenes stay in cache over the substeps anyway, blocks would only add the snapshots and checks
+	if(particles.Size() < blockMinTiles * tileParticleTarget)
+	{
+		return 1;
+	}
+
+	//Lists are only rebuilt between blocks, so blocks are kept short enough for the fastest particle to stay inside of the skin
+	const float step = std::sqrtf(maxSqrStep.load()) * blockTravelFactor;
+	uint32_t length = std::min(std::max(blockSubsteps, 1u), remaining);
+	while(length > 1 && step * static_cast<float>(length) >= neighborSkin * 0.5f)
+	{
+		length--;
+	}
+	return length;
+}
+
+bool VerletSolver::SimulateBlock(float dt, uint32_t steps)
+{
+	broadPhaseCounter.BeginSubFrame();
+	if(neighborStripeWidth != minStripeWidth || NeighborListsStale())
+	{
+		BuildNeighborLists();
+	}
+	broadPhaseCounter.EndSubFrame();
+
+	//Integration is part of the tiles, so the narrow phase counter measures both
+	narrowPhaseCounter.BeginSubFrame();
+	const ConstraintKernel constrain = constraint.BatchKernel(simdLevel);
+	const float blockMaxSqrStep = maxSqrStep.load();
+	const float blockListTravel = maxSqrListTravel.load();
+	const uint64_t blockPairTests = pairTests.load();
+	const uint64_t blockIntegratedSteps = integratedSteps.load();
+	blockStale = false;
+	maxSqrStep = 0.0f;
+	//Penetration stats cover all substeps of the block
+	passMaxPenetration = 0.0f;
+	passPenetrationSum = 0.0;
+	passContacts = 0;
+
+	//A substep of a stripe solves the pairs of the stripe and its right neighbor, alternating between even and odd stripes as in
+	//SolveNeighborLists, and then integrates the stripe. That needs the stripes up to two to each side to be done with the
+	//substep before, so every substep the finished part of a tile shrinks by two stripes on each side it shares with unfinished work
+	//All tiles of a job are run one after the other, each cut moving left two stripes per substep behind the last one,
+	//the first and last tile of a job also shrink towards the inside. The triangles left between the jobs are filled in afterwards
+	//Every pair and particle is still updated exactly once per substep with the same inputs, so the result matches the regular order
+	const int32_t stripes = static_cast<int32_t>(neighborPairs.size());
+	const int32_t count = static_cast<int32_t>(steps);
+	const int32_t jobs = std::clamp(stripes / (4 * count), 1, static_cast<int32_t>(threadPool.ThreadCount()));
+	const int32_t stripeParticles = std::max(static_cast<int32_t>(particles.Size()) / std::max(stripes, 1), 1);
+	const int32_t tileWidth = std::max(static_cast<int32_t>(tileParticleTarget) / stripeParticles, 1);
+
+	//A particle pushed out of the skin in one substep could miss a pair in the next one, so the block has to be undone in that case
+	//The pairs of a job's last stripe reach into the first stripe of the next job, which is saved up front, the jobs save the rest
+	blockStripeOffsets.resize(stripes + 1);
+	blockStripeOffsets[0] = 0;
+	for(int32_t stripe = 0; stripe < stripes; stripe++)
+	{
+		blockStripeOffsets[stripe + 1] = blockStripeOffsets[stripe] + static_cast<uint32_t>(neighborStripeParticles[stripe].size());
+	}
+	blockStates.resize(blockStripeOffsets.back());
+	jobSavedStripes.resize(jobs);
+	for(int32_t job = 1; job < jobs; job++)
+	{
+		const int32_t boundary = job * stripes / jobs;
+		SaveStripes(boundary, boundary + 1);
+	}
+
+	auto clampCut = [stripes](int32_t even, int32_t odd, int32_t integrate)
+	{
+		return StripeCut { std::clamp(even, 0, stripes), std::clamp(odd, 0, stripes), std::clamp(integrate, 0, stripes) };
+	};
+	//Cut between the work on the left, which is done with substep k, and the work on the right, which is only done with substep k - 1
+	auto trailing = [&](int32_t stripe, int32_t k) { return clampCut(stripe - 2 * k, stripe - 2 * k - 1, stripe - 2 * k - 1); };
+	//The other way around
+	auto leading = [&](int32_t stripe, int32_t k) { return clampCut(stripe + 2 * k, stripe + 2 * k + 1, stripe + 2 * k + 2); };
+
+	for(int32_t job = 0; job < jobs; job++)
+	{
+		const int32_t begin = job * stripes / jobs;
+		const int32_t end = (job + 1) * stripes / jobs;
+		threadPool.EnqueueJob([this, dt, constrain, stripes, count, tileWidth, job, begin, end, &clampCut, &trailing, &leading]
+		{
+			int32_t& saved = jobSavedStripes[job];
+			saved = job == 0 ? begin : begin + 1;
+			for(int32_t tile = begin; tile < end && !blockStale.load(std::memory_order_relaxed); tile += tileWidth)
+			{
+				//The pairs of the tile's last stripe reach one stripe further
+				const int32_t reach = std::min(tile + tileWidth + 1, end);
+				SaveStripes(saved, reach);
+				saved = std::max(saved, reach);
+				for(int32_t k = 0; k < count; k++)
+				{
+					const StripeCut first = begin == 0 ? clampCut(0, 0, 0) : leading(begin, k);
+					const StripeCut last = end == stripes ? clampCut(stripes, stripes, stripes) : trailing(end, k);
+					StripeCut from = tile == begin ? first : trailing(tile, k);
+					StripeCut to = tile + tileWidth >= end ? last : trailing(tile + tileWidth, k);
+					//Tiles the shrinking job has already passed do nothing
+					for(size_t part = 0; part < from.size(); part++)
+					{
+						from[part] = std::clamp(from[part], first[part], last[part]);
+						to[part] = std::clamp(to[part], from[part], last[part]);
+					}
+					AdvanceStripes(from, to, dt, constrain, k + 1 < count);
+				}
+			}
+		});
+	}
+	threadPool.WaitForCompletion();
+
+	//Jobs are at least four stripes per substep wide, so the triangles don't touch each other
+	for(int32_t job = 1; job < jobs && !blockStale.load(); job++)
+	{
+		const int32_t boundary = job * stripes / jobs;
+		threadPool.EnqueueJob([this, dt, constrain, count, boundary, &trailing, &leading]
+		{
+			for(int32_t k = 0; k < count; k++)
+			{
+				AdvanceStripes(trailing(boundary, k), leading(boundary, k), dt, constrain, k + 1 < count);
+			}
+		});
+	}
+	threadPool.WaitForCompletion();
+
+	if(blockStale.load())
+	{
+		for(int32_t job = 0; job < jobs; job++)
+		{
+			const int32_t begin = job * stripes / jobs;
+			threadPool.EnqueueJob([this, job, begin]
+			{
+				RestoreStripes(begin, jobSavedStripes[job]);
+			});
+		}
+		threadPool.WaitForCompletion();
+		maxSqrStep = blockMaxSqrStep;
+		maxSqrListTravel = blockListTravel;
+		pairTests = blockPairTests;
+		integratedSteps = blockIntegratedSteps;
+		blockRollbackCount++;
+		narrowPhaseCounter.EndSubFrame();
+		return false;
+	}
+
+	collisionSteps += steps;
+	collisionPasses += steps;
+	blockedSubstepCount += steps;
+
+	const uint64_t overlapping = passContacts.load();
+	lastMaxPenetration = passMaxPenetration.load();
+	lastMeanPenetration = overlapping > 0 ? static_cast<float>(passPenetrationSum.load() / static_cast<double>(overlapping)) : 0.0f;
+	narrowPhaseCounter.EndSubFrame();
+	return true;
+}
+
+void VerletSolver::SaveStripes(int32_t begin, int32_t end)
+{
+	for(int32_t stripe = begin; stripe < end; stripe++)
+	{
+		BlockState* state = blockStates.data() + blockStripeOffsets[stripe];
+		for(uint32_t i : neighborStripeParticles[stripe])
+		{
+			*state++ = { particles.Position(i), particles.PrevPosition(i), Vector2(particles.accX[i], particles.accY[i]) };
+		}
+	}
+}
+
+void VerletSolver::RestoreStripes(int32_t begin, int32_t end)
+{
+	for(int32_t stripe = begin; stripe < end; stripe++)
+	{
+		const BlockState* state = blockStates.data() + blockStripeOffsets[stripe];
+		for(uint32_t i : neighborStripeParticles[stripe])
+		{
+			particles.SetPosition(i, state->pos);
+			particles.SetPrevPosition(i, state->prev);
+			particles.accX[i] = state->acc.x;
+			particles.accY[i] = state->acc.y;
+			state++;
+		}
+	}
+}
+
+void VerletSolver::AdvanceStripes(const StripeCut& from, const StripeCut& to, float dt, ConstraintKernel constrain, bool checkLists)
+{
+	uint64_t tests = 0;
+	float maxPenetration = 0.0f;
+	double penetrationSum = 0.0;
+	uint64_t overlapping = 0;
+	for(int32_t parity = 0; parity < 2; parity++)
+	{
+		for(int32_t stripe = from[parity] + ((from[parity] & 1) != parity ? 1 : 0); stripe < to[parity]; stripe += 2)
+		{
+			for(const auto& [a, b] : neighborPairs[stripe])
+			{
+				const float penetration = Solve(a, b);
+				if(penetration > 0.0f)
+				{
+					maxPenetration = std::max(maxPenetration, penetration);
+					penetrationSum += penetration;
+					overlapping++;
+				}
+			}
+			tests += neighborPairs[stripe].size();
+		}
+	}
+	pairTests += tests;
+	MergePenetration(maxPenetration, penetrationSum, overlapping);
+
+	float sqrTravel = 0.0f;
+	for(int32_t stripe = from[2]; stripe < to[2]; stripe++)
+	{
+		const std::vector<uint32_t>& stripeParticles = neighborStripeParticles[stripe];
+		sqrTravel = std::max(sqrTravel, IntegrateParticles(0, stripeParticles.data(), stripeParticles.size(), dt, constrain));
+	}
+	MergeListTravel(sqrTravel);
+	//Same limit as NeighborListsStale, checked for the next substep of the block
+	const float maxDst = neighborSkin * 0.5f;
+	if(checkLists && sqrTravel > maxDst * maxDst)
+	{
+		blockStale = true;
+	}
+}
+
+void VerletSolver::ContinuousCollisions()
+{
+	//Particles of slower cells move up to their stride times the distance per substep in one of their steps
+	const float minStep = ccdThreshold * partitioningTuner.MinRadius() / static_cast<float>(1u << maxRateShift);
+	if(maxSqrStep.load() <= minStep * minStep)
+	{
+		return;
+	}
+
+	narrowPhaseCounter.BeginSubFrame();
+	const std::span<const uint32_t> active = ActiveParticles();
+	const std::vector<std::pair<size_t, size_t>> jobs = ThreadPool::SplitWork(active.size(), threadPool.ThreadCount());
+	jobFastParticles.resize(jobs.size());
+	for(size_t job = 0; job < jobs.size(); job++)
+	{
+		jobFastParticles[job].clear();
+		const auto [offset, amount] = jobs[job];
+		if(amount == 0)
+		{
+			continue;
+		}
+
+		threadPool.EnqueueJob([this, active, job, offset, amount]
+		{
+			std::vector<uint32_t>& fast = jobFastParticles[job];
+			const float sqrThreshold = ccdThreshold * ccdThreshold;
+			for(size_t k = offset; k < offset + amount; k++)
+			{
+				const uint32_t i = active[k];
+				if(particles.IsResting(i))
+				{
+					continue;
+				}
+				const float r = particles.radius[i];
+				if((particles.Position(i) - particles.PrevPosition(i)).SqrLength() > sqrThreshold * r * r)
+				{
+					fast.push_back(i);
+				}
+			}
+		});
+	}
+	threadPool.WaitForCompletion();
+
+	fastParticles.clear();
+	for(const std::vector<uint32_t>& fast : jobFastParticles)
+	{
+		fastParticles.insert(fastParticles.end(), fast.begin(), fast.end());
+	}
+	sweptParticleCount += static_cast<uint32_t>(fastParticles.size());
+
+	//Sweeps only read positions, the contacts are applied afterwards so particles never sweep against moved ones
+	sweptPositions.resize(fastParticles.size());
+	sweptPrevPositions.resize(fastParticles.size());
+	for(const auto& [offset, amount] : ThreadPool::SplitWork(fastParticles.size(), threadPool.ThreadCount()))
+	{
+		if(amount == 0)
+		{
+			continue;
+		}
+
+		threadPool.EnqueueJob([this, offset, amount]
+		{
+			for(size_t k = offset; k < offset + amount; k++)
+			{
+				const uint32_t i = fastParticles[k];
+				const Vector2 from = particles.PrevPosition(i);
+				const Vector2 to = particles.Position(i);
+				float t = 1.0f;
+				Vector2 normal = Vector2::zero;
+				const bool hitParticle = SweepParticles(i, from, to, t, normal);
+				const bool hitCollider = colliders.Sweep(from, to, particles.radius[i], t, normal);
+				if(!hitParticle && !hitCollider)
+				{
+					sweptPositions[k] = to;
+					sweptPrevPositions[k] = from;
+					continue;
+				}
+
+				//Stops at the contact and keeps only the velocity along it, the narrow phase then resolves the contact as usual
+				const Vector2 vel = to - from;
+				const Vector2 pos = from + vel * t;
+				sweptPositions[k] = pos;
+				sweptPrevPositions[k] = pos - (vel - normal * std::min(Vector2::Dot(vel, normal), 0.0f));
+			}
+		});
+	}
+	threadPool.WaitForCompletion();
+
+	for(size_t k = 0; k < fastParticles.size(); k++)
+	{
+		particles.SetPosition(fastParticles[k], sweptPositions[k]);
+		particles.SetPrevPosition(fastParticles[k], sweptPrevPositions[k]);
+	}
+	narrowPhaseCounter.EndSubFrame();
+}
+
+bool VerletSolver::SweepParticles(uint32_t index, Vector2 from, Vector2 to, float& t, Vector2& normal) const
+{
+	const float radius = particles.radius[index];
+	const Vector2 min = Vector2(std::min(from.x, to.x) - radius, std::min(from.y, to.y) - radius);
+	const Vector2 max = Vector2(std::max(from.x, to.x) + radius, std::max(from.y, to.y) + radius);
+	const Vector2 delta = to - from;
+	const float a = delta.SqrLength();
+	bool hit = false;
+	auto sweepGrid = [&](const PartitioningGrid& grid)
+	{
+		if(grid.Size() == 0)
+		{
+			return;
+		}
+
+		//Particles are binned by their center, so the ring around the path's cells holds the ones reaching into it
+		const auto [minX, minY] = grid.CellCoords(min);
+		const auto [maxX, maxY] = grid.CellCoords(max);
+		const int32_t cellsY = grid.CellsY();
+		const int32_t beginY = std::max(minY - 1, 0);
+		const int32_t endY = std::min(maxY + 2, cellsY);
+		for(int32_t x = std::max(minX - 1, 0); x < std::min(maxX + 2, grid.CellsX()); x++)
+		{
+			for(const uint32_t other : grid.Range(x * cellsY + beginY, x * cellsY + endY))
+			{
+				//The particle's own current position lies on its path
+				if(other == index)
+				{
+					continue;
+				}
+				const Vector2 m = from - particles.Position(other);
+				const float minDst = radius + particles.radius[other];
+				const float b = Vector2::Dot(m, delta);
+				const float c = m.SqrLength() - minDst * minDst;
+				//Pairs touching at the start are left to the narrow phase, which also skips the particle itself
+				if(b >= 0.0f || c <= 0.0f)
+				{
+					continue;
+				}
+				const float disc = b * b - a * c;
+				if(disc < 0.0f)
+				{
+					continue;
+				}
+
+				const float otherT = (-b - std::sqrtf(disc)) / a;
+				if(otherT < t)
+				{
+					t = otherT;
+					normal = (m + delta * otherT) / minDst;
+					hit = true;
+				}
+			}
+		}
+	};
+	for(uint32_t level = 0; level < partitioning.LevelCount(); level++)
+	{
+		sweepGrid(partitioning.Level(level));
+	}
+	sweepGrid(partitioning.StaticLayer());
+	return hit;
+}
+
+void VerletSolver::SolveCell(NarrowPhase::PackedCell& cell)
+{
+	cell.tests += cell.count * (cell.count - 1) / 2;
+	NarrowPhase::SolveCell(simdLevel, particles, cell, [this, &cell](uint32_t a, uint32_t b) { cell.AddPenetration(Solve(a, b)); });
+}
+
+void VerletSolver::SolveCells(PartitioningCell cell0, NarrowPhase::PackedCell& cell1)
+{
+	cell1.tests += cell0.size() * cell1.count;
+	NarrowPhase::SolveCells(simdLevel, particles, cell0.data(), cell0.size(), cell1, [this, &cell1](uint32_t a, uint32_t b) { cell1.AddPenetration(Solve(a, b)); });
+}
+
+float VerletSolver::Solve(uint32_t a, uint32_t b)
+{
+	if(particles.IsResting(a) && particles.IsResting(b))
+	{
+		return 0.0f;
+	}
+
+	Vector2 aPos = particles.Position(a);
+	Vector2 bPos = particles.Position(b);
+	Vector2 dir = aPos - bPos;
+	float dst = std::max(dir.SqrLength(), 0.001f);
+	float radSum = particles.radius[a] + particles.radius[b];
+	if(dst < radSum * radSum)
+	{
+		dst = std::sqrtf(dst);
+		Vector2 normDir = dir / dst;
+		float overlap = radSum - dst;
+
+		//Sleeping particles act like pinned ones, so piles don't sink into themselves while asleep
+		Separate(a, b, normDir, overlap);
+		if(sleeping)
+		{
+			Press(a, b);
+			Press(b, a);
+		}
+		return overlap / radSum;
+	}
+	return 0.0f;
+}
+
+void VerletSolver::Separate(uint32_t a, uint32_t b, Vector2 dir, float amount)
+{
+	auto [aMul, bMul] = CalcMassRatio(particles.EffectiveInvMass(a), particles.EffectiveInvMass(b));
+	//Waiting particles stay where they are until their next step, so the other particle moves the whole way
+	//but only keeps its share of the correction as velocity, the rest becomes velocity of the waiting one
+	const bool aWaiting = particles.HasFlag(a, ParticleFlags::Waiting);
+	const bool bWaiting = particles.HasFlag(b, ParticleFlags::Waiting);
+	if((aWaiting || bWaiting) && particles.IsResting(a) && particles.IsResting(b))
+	{
+		return;
+	}
+	if(bWaiting)
+	{
+		const Vector2 shift = dir * (amount * bMul);
+		particles.SetPosition(a, particles.Position(a) + dir * amount);
+		particles.SetPrevPosition(a, particles.PrevPosition(a) + shift);
+		particles.SetPrevPosition(b, particles.PrevPosition(b) + shift);
+		return;
+	}
+	if(aWaiting)
+	{
+		const Vector2 shift = dir * (amount * aMul);
+		particles.SetPosition(b, particles.Position(b) - dir * amount);
+		particles.SetPrevPosition(b, particles.PrevPosition(b) - shift);
+		particles.SetPrevPosition(a, particles.PrevPosition(a) - shift);
+		return;
+	}
+	particles.SetPosition(a, particles.Position(a) + dir * (amount * aMul));
+	particles.SetPosition(b, particles.Position(b) - dir * (amount * bMul));
+}
+
+float VerletSolver::Accumulate(uint32_t a, uint32_t b)
+{
+	//Sleeping particles still look at awake ones, only to notice being pushed, waiting ones take their share of the correction
+	const bool pressed = sleeping && particles.HasFlag(a, ParticleFlags::Sleeping) && !particles.IsResting(b);
+	const bool waiting = particles.HasFlag(a, ParticleFlags::Waiting) && !particles.IsResting(b);
+	if(a == b || (particles.IsResting(a) && !pressed && !waiting))
+	{
+		return 0.0f;
+	}
+
+	Vector2 dir = particles.Position(a) - particles.Position(b);
+	float dst = std::max(dir.SqrLength(), 0.001f);
+	float radSum = particles.radius[a] + particles.radius[b];
+	if(dst < radSum * radSum)
+	{
+		dst = std::sqrtf(dst);
+		Vector2 normDir = dir / dst;
+		float overlap = radSum - dst;
+		if(pressed)
+		{
+			Press(a, b);
+			return 0.0f;
+		}
+
+		auto [aMul, bMul] = CalcMassRatio(particles.EffectiveInvMass(a), particles.EffectiveInvMass(b));
+		if(waiting)
+		{
+			//Same split as Separate, the waiting particle only takes its share as velocity
+			prevDeltaX[a] -= normDir.x * (overlap * aMul);
+			prevDeltaY[a] -= normDir.y * (overlap * aMul);
+		}
+		else if(particles.HasFlag(b, ParticleFlags::Waiting))
+		{
+			deltaX[a] += normDir.x * overlap;
+			deltaY[a] += normDir.y * overlap;
+			prevDeltaX[a] += normDir.x * (overlap * bMul);
+			prevDeltaY[a] += normDir.y * (overlap * bMul);
+		}
+		else
+		{
+			deltaX[a] += normDir.x * (overlap * aMul);
+			deltaY[a] += normDir.y * (overlap * aMul);
+		}
+		contacts[a]++;
+		return overlap / radSum;
+	}
+	return 0.0f;
+}
+
+void VerletSolver::Press(uint32_t index, uint32_t other)
+{
+	if(particles.HasFlag(index, ParticleFlags::Sleeping) && !particles.IsResting(other))
+	{
+		particles.SetFlag(index, ParticleFlags::Pressed);
+	}
+}
+
+void VerletSolver::UpdateObjects(float dt)
+{
+	updatePhaseCounter.BeginSubFrame();
+
+	//Pinned flags are fixed once a particle is in storage
+	if(movingStorageVersion != particles.Version())
+	{
+		movingParticles.clear();
+		for(uint32_t i = 0; i < particles.Size(); i++)
+		{
+			if(!particles.HasFlag(i, ParticleFlags::Pinned))
+			{
+				movingParticles.push_back(i);
+			}
+		}
+		movingStorageVersion = particles.Version();
+	}
+
+	//When every particle moves the storage is integrated in place, which saves gathering the positions for the force fields
+	const ConstraintKernel constrain = constraint.BatchKernel(simdLevel);
+	const std::span<const uint32_t> active = ActiveParticles();
+	const uint32_t* indices = active.size() != particles.Size() ? active.data() : nullptr;
+	maxSqrStep = 0.0f;
+	for(const auto& [offset, amount] : ThreadPool::SplitWork(active.size(), threadPool.ThreadCount()))
+	{
+		if(amount == 0)
+		{
+			continue;
+		}
+
+		threadPool.EnqueueJob([this, dt, constrain, indices, offset, amount]
+		{
+			MergeListTravel(IntegrateParticles(offset, indices != nullptr ? indices + offset : nullptr, amount, dt, constrain));
+		});
+	}
+	threadPool.WaitForCompletion();
+
+	updatePhaseCounter.EndSubFrame();
+}
+
+float VerletSolver::IntegrateParticles(size_t offset, const uint32_t* indices, size_t amount, float dt, ConstraintKernel constrain)
+{
+	const bool staticCollisions = collision && !colliders.Empty();
+	//Sweeps move particles back along the step, so both ends of it bound how far a particle got from the lists
+	const bool listTravel = neighborLists && neighborX.size() == particles.Size();
+	//Force fields are evaluated for a block of particles at a time, one field after another
+	std::array<float, updateBlockSize> fieldAccX = {};
+	std::array<float, updateBlockSize> fieldAccY = {};
+	//Positions of listed particles, gathered for the force fields
+	std::array<float, updateBlockSize> fieldX = {};
+	std::array<float, updateBlockSize> fieldY = {};
+	std::array<float, updateBlockSize> fieldInvMass = {};
+	//Particles of the block which move this step, gathered so the world constrains them in one batch
+	std::array<uint32_t, updateBlockSize> moving = {};
+	std::array<float, updateBlockSize> posX = {};
+	std::array<float, updateBlockSize> posY = {};
+	std::array<float, updateBlockSize> prevX = {};
+	std::array<float, updateBlockSize> prevY = {};
+	std::array<float, updateBlockSize> radius = {};
+	std::array<float, updateBlockSize> bounciness = {};
+	std::array<Vector2, updateBlockSize> accs = {};
+	std::array<float, updateBlockSize> strides = {};
+	std::array<bool, updateBlockSize> pushes = {};
+	float jobMaxSqrStep = 0.0f;
+	float jobMaxSqrListTravel = 0.0f;
+	uint64_t jobIntegrated = 0;
+	for(size_t block = 0; block < amount; block += updateBlockSize)
+	{
+		const size_t count = std::min(updateBlockSize, amount - block);
+		fieldAccX.fill(0.0f);
+		fieldAccY.fill(0.0f);
+		if(!forceFields.Empty() && indices == nullptr)
+		{
+			const size_t begin = offset + block;
+			forceFields.Accumulate(particles.posX.data() + begin, particles.posY.data() + begin, particles.invMass.data() + begin, count, fieldAccX.data(), fieldAccY.data());
+		}
+		else if(!forceFields.Empty())
+		{
+			for(size_t k = 0; k < count; k++)
+			{
+				const uint32_t i = indices[block + k];
+				fieldX[k] = particles.posX[i];
+				fieldY[k] = particles.posY[i];
+				fieldInvMass[k] = particles.invMass[i];
+			}
+			forceFields.Accumulate(fieldX.data(), fieldY.data(), fieldInvMass.data(), count, fieldAccX.data(), fieldAccY.data());
+		}
+
+		size_t movingCount = 0;
+		for(size_t k = 0; k < count; k++)
+		{
+			const size_t i = indices ? indices[block + k] : offset + block + k;
+
+			//Make sure applied forces (like initial) are represented as force over 1 second to make it delta time and substep independent
+			//and apply mass to them
+			const float invMass = particles.invMass[i];
+			const float stride = static_cast<float>(1u << particles.rateShift[i]);
+			Vector2 acc = Vector2(particles.accX[i], particles.accY[i]) * (invMass / (dt * stride));
+
+			//Gravity
+			acc.x += gravity.x;
+			acc.y += gravity.y;
+
+			//Colliders come right after the particle collisions, so piles can't press particles through them
+			Vector2 pos = particles.Position(i);
+			if(staticCollisions && !particles.HasFlag(i, ParticleFlags::Sleeping))
+			{
+				colliders.Resolve(pos, particles.radius[i]);
+			}
+			Vector2 fieldAcc = Vector2(fieldAccX[k], fieldAccY[k]);
+			if(bakedForceField)
+			{
+				fieldAcc += bakedForceField->Sample(pos);
+			}
+
+			//Sleeping particles stay in place unless an applied force or a lasting push of an awake particle moves them
+			//Fields don't change under a particle that stays in place, so like gravity they only keep it pressed into the pile
+			bool pushed = false;
+			if(particles.HasFlag(i, ParticleFlags::Sleeping))
+			{
+				pushed = sleeping && UpdatePressure(i, dt * stride);
+				if(sleeping && particles.accX[i] == 0.0f && particles.accY[i] == 0.0f && !pushed)
+				{
+					particles.SetPrevPosition(i, pos);
+					continue;
+				}
+				particles.Wake(i);
+			}
+			acc += fieldAcc;
+
+			moving[movingCount] = static_cast<uint32_t>(i);
+			posX[movingCount] = pos.x;
+			posY[movingCount] = pos.y;
+			prevX[movingCount] = particles.prevX[i];
+			prevY[movingCount] = particles.prevY[i];
+			radius[movingCount] = particles.radius[i];
+			bounciness[movingCount] = particles.bounciness[i];
+			accs[movingCount] = acc;
+			strides[movingCount] = stride;
+			pushes[movingCount] = pushed;
+			movingCount++;
+		}
+
+		//Constrain
+		constrain(constraint, { posX.data(), posY.data(), prevX.data(), prevY.data(), radius.data(), bounciness.data(), movingCount });
+
+		//Update
+		for(size_t m = 0; m < movingCount; m++)
+		{
+			const uint32_t i = moving[m];
+			const Vector2 pos = Vector2(posX[m], posY[m]);
+			const Vector2 vel = pos - Vector2(prevX[m], prevY[m]);
+			const float stepDt = dt * strides[m];
+			particles.SetPrevPosition(i, pos);
+			const Vector2 newPos = pos + vel + accs[m] * (stepDt * stepDt);
+			particles.SetPosition(i, newPos);
+			particles.accX[i] = 0.0f;
+			particles.accY[i] = 0.0f;
+
+			//Particles taking longer steps move less per substep
+			const float sqrStep = (newPos - pos).SqrLength();
+			jobMaxSqrStep = std::max(jobMaxSqrStep, sqrStep / (strides[m] * strides[m]));
+			if(listTravel)
+			{
+				jobMaxSqrListTravel = std::max(jobMaxSqrListTravel, std::max(ListTravel(i, pos), ListTravel(i, newPos)));
+			}
+			if(sleeping)
+			{
+				UpdateSleepState(i, newPos, sqrStep, stepDt);
+
+				//A pushed particle barely moves on its own, it counts as moving so the rest of the pile around it wakes up as well
+				if(pushes[m])
+				{
+					particles.SetFlag(i, ParticleFlags::Moving);
+				}
+			}
+		}
+		jobIntegrated += movingCount;
+	}
+	integratedSteps += jobIntegrated;
+
+	float current = maxSqrStep.load();
+	while(current < jobMaxSqrStep && !maxSqrStep.compare_exchange_weak(current, jobMaxSqrStep));
+	return jobMaxSqrListTravel;
+}
+
+void VerletSolver::UpdateLinks(float dt)
+{
+	linkPhaseCounter.BeginSubFrame();
+	for(size_t color = 0; color + 1 < linkColorOffsets.size(); color++)
+	{
+		const size_t begin = linkColorOffsets[color];
+		const size_t end = linkColorOffsets[color + 1];
+		if(end - begin < parallelLinkThreshold)
+		{
+			MergeListTravel(SolveLinks(begin, end, dt));
+			continue;
+		}
+
+		for(const auto& [offset, amount] : ThreadPool::SplitWork(end - begin, threadPool.ThreadCount()))
+		{
+			if(amount == 0)
+			{
+				continue;
+			}
+
+			threadPool.EnqueueJob([this, dt, offset = begin + offset, amount]
+			{
+				MergeListTravel(SolveLinks(offset, offset + amount, dt));
+			});
+		}
+		threadPool.WaitForCompletion();
+	}
+	linkPhaseCounter.EndSubFrame();
+}
+
+float VerletSolver::SolveLinks(size_t begin, size_t end, float dt)
+{
+	//Links move particles after they were integrated, so they count towards how far particles got from the lists as well
+	const bool listTravel = neighborLists && neighborX.size() == particles.Size();
+	float sqrTravel = 0.0f;
+	for(size_t i = begin; i < end; i++)
+	{
+		const SolverLink& l = links[i];
+		SolveLink(l, dt);
+		if(listTravel)
+		{
+			sqrTravel = std::max(sqrTravel, std::max(ListTravel(l.a, particles.Position(l.a)), ListTravel(l.b, particles.Position(l.b))));
+		}
+	}
+	return sqrTravel;
+}
+
+void VerletSolver::BuildLinks()
+{
+	//Links are only ever added, so the table is outdated if the amount changed or particles were inserted, reorders remap it instead
+	size_t linkCount = 0;
+	ecs.QueryChunked<Transform, Link>(std::numeric_limits<size_t>::max(), [&](Transform* _, Link* l, size_t count)
+	{
+		linkCount += count;
+	});
+	if(linkCount == linkParticles.size() && linkStorageVersion == particles.Version())
+	{
+		return;
+	}
+	linkStorageVersion = particles.Version();
+
+	std::vector<SolverLink> unordered = {};
+	unordered.reserve(linkCount);
+	linkParticles.clear();
+	ecs.QueryChunked<Transform, Link>(std::numeric_limits<size_t>::max(), [&](Transform* _, Link* l, size_t count)
+	{
+		for(size_t i = 0; i < count; i++)
+		{
+			const uint32_t a = particles.IndexOf(l[i].e0).value();
+			const uint32_t b = particles.IndexOf(l[i].e1).value();
+			linkParticles.emplace_back(a, b);
+			unordered.push_back({ a, b, l[i].distance, l[i].restrictMin, l[i].restrictMax });
+		}
+	});
+
+	//Links of each particle, stored by particle like the partitioning grid
+	std::vector<uint32_t> particleLinkStart = std::vector<uint32_t>(particles.Size() + 1, 0);
+	for(const SolverLink& l : unordered)
+	{
+		particleLinkStart[l.a + 1]++;
+		particleLinkStart[l.b + 1]++;
+	}
+	std::inclusive_scan(particleLinkStart.begin(), particleLinkStart.end(), particleLinkStart.begin());
+	std::vector<uint32_t> particleLinks = std::vector<uint32_t>(particleLinkStart.back());
+	std::vector<uint32_t> fill = std::vector<uint32_t>(particleLinkStart.begin(), particleLinkStart.end() - 1);
+	for(uint32_t i = 0; i < unordered.size(); i++)
+	{
+		particleLinks[fill[unordered[i].a]++] = i;
+		particleLinks[fill[unordered[i].b]++] = i;
+	}
+
+	//Walking breadth first along the linked particles puts ropes and chains in their natural order
+	std::vector<uint32_t> order = {};
+	order.reserve(unordered.size());
+	std::vector<uint8_t> visited = std::vector<uint8_t>(particles.Size(), 0);
+	std::vector<uint8_t> emitted = std::vector<uint8_t>(unordered.size(), 0);
+	std::vector<uint32_t> queue = {};
+	for(uint32_t root = 0; root < particles.Size(); root++)
+	{
+		if(visited[root] || particleLinkStart[root] == particleLinkStart[root + 1])
+		{
+			continue;
+		}
+
+		visited[root] = 1;
+		queue.assign(1, root);
+		for(size_t head = 0; head < queue.size(); head++)
+		{
+			const uint32_t particle = queue[head];
+			for(uint32_t k = particleLinkStart[particle]; k < particleLinkStart[particle + 1]; k++)
+			{
+				const uint32_t link = particleLinks[k];
+				if(emitted[link])
+				{
+					continue;
+				}
+				emitted[link] = 1;
+				order.push_back(link);
+
+				const uint32_t other = unordered[link].a == particle ? unordered[link].b : unordered[link].a;
+				if(!visited[other])
+				{
+					visited[other] = 1;
+					queue.push_back(other);
+				}
+			}
+		}
+	}
+
+	//Greedy coloring, every link gets the first class neither of its particles is part of yet
+	std::vector<std::vector<uint32_t>> colors = {};
+	std::vector<std::vector<uint8_t>> usedParticles = {};
+	for(uint32_t link : order)
+	{
+		const uint32_t a = unordered[link].a;
+		const uint32_t b = unordered[link].b;
+		size_t color = 0;
+		while(color < colors.size() && (usedParticles[color][a] || usedParticles[color][b]))
+		{
+			color++;
+		}
+		if(color == colors.size())
+		{
+			colors.emplace_back();
+			usedParticles.emplace_back(particles.Size(), 0);
+		}
+		usedParticles[color][a] = 1;
+		usedParticles[color][b] = 1;
+		colors[color].push_back(link);
+	}
+
+	links.clear();
+	linkColorOffsets.assign(1, 0);
+	for(const std::vector<uint32_t>& color : colors)
+	{
+		for(uint32_t link : color)
+		{
+			links.push_back(unordered[link]);
+		}
+		linkColorOffsets.push_back(links.size());
+	}
+}
+
+void VerletSolver::BuildForceFields()
+{
+	size_t fieldCount = 0;
+	ecs.WithAllOfComponent<ForceField>([&](std::span<const ForceField> fields)
+	{
+		fieldCount += fields.size();
+	});
+	//The lists only change with the fields or with the cells of the grid
+	const PartitioningGrid& grid = partitioning.Level(0);
+	if(fieldCount == builtFieldCount && grid.CellsX() == forceFields.CellsX() && grid.CellsY() == forceFields.CellsY())
+	{
+		return;
+	}
+
+	//New fields change the acceleration of particles which fell asleep under the old ones, they fall asleep again if it doesn't move them
+	if(sleeping && fieldCount != builtFieldCount)
+	{
+		for(size_t i = 0; i < particles.Size(); i++)
+		{
+			if(particles.HasFlag(i, ParticleFlags::Sleeping))
+			{
+				particles.Wake(i);
+			}
+		}
+	}
+	builtFieldCount = fieldCount;
+
+	std::vector<ForceFieldKernels::PreparedField> prepared = {};
+	ecs.WithAllOfComponent<ForceField>([&](std::span<const ForceField> fields)
+	{
+		for(const ForceField& field : fields)
+		{
+			if(!bakeForceFields || field.settings.massDependent)
+			{
+				prepared.push_back(ForceFieldKernels::Prepare(field));
+			}
+		}
+	});
+	forceFields.Build(std::move(prepared), constraint.Bounds().first, constraint.Bounds().second, grid.CellsX(), grid.CellsY());
+
+	if(bakeForceFields && fieldCount != bakedFieldCount)
+	{
+		BakeForceFields();
+		bakedFieldCount = fieldCount;
+	}
+}
+
+void VerletSolver::BakeForceFields()
+{
+	//Mass dependent fields scale with each particle and keep being evaluated
+	std::vector<ForceFieldKernels::PreparedField> fields = {};
+	ecs.WithAllOfComponent<ForceField>([&](std::span<const ForceField> componentFields)
+	{
+		for(const ForceField& field : componentFields)
+		{
+			if(!field.settings.massDependent)
+			{
+				fields.push_back(ForceFieldKernels::Prepare(field));
+			}
+		}
+	});
+	if(fields.empty())
+	{
+		bakedForceField = std::nullopt;
+		return;
+	}
+
+	bakedForceField.emplace(constraint.Bounds().first, constraint.Bounds().second, forceFieldResolution);
+	bakedForceField->Bake([&](Vector2 pos)
+	{
+		const float invMass = 1.0f;
+		Vector2 force = Vector2::zero;
+		for(const ForceFieldKernels::PreparedField& field : fields)
+		{
+			field.kernel(field, &pos.x, &pos.y, &invMass, 1, &force.x, &force.y);
+		}
+		return force;
+	}, threadPool);
+}
+
+void VerletSolver::BuildColliders()
+{
+	size_t colliderCount = 0;
+	ecs.WithAllOfComponent<Collider>([&](std::span<const Collider> components)
+	{
+		colliderCount += components.size();
+	});
+	if(colliderCount == builtColliderCount)
+	{
+		return;
+	}
+	builtColliderCount = colliderCount;
+
+	std::vector<StaticColliders::Segment> segments = {};
+	segments.reserve(colliderCount);
+	ecs.WithAllOfComponent<Collider>([&](std::span<const Collider> components)
+	{
+		for(const Collider& c : components)
+		{
+			segments.push_back({ c.from, c.to, c.radius });
+		}
+	});
+	colliders.Build(segments);
+}
+
+void VerletSolver::SolveLink(const SolverLink& l, float dt)
+{
+	const uint32_t a = l.a;
+	const uint32_t b = l.b;
+	Vector2 aPos = particles.Position(a);
+	Vector2 bPos = particles.Position(b);
+
+	Vector2 dir = (bPos - aPos);
+	float len = dir.Normalize();
+	float off = len - l.distance;
+	if((l.restrictMax && off > 0.0f) || (l.restrictMin && off < 0.0f))
+	{
+		//Links pulling harder than the sleep threshold wake both ends
+		if(sleeping && std::fabs(off) > sleepVelocity * dt)
+		{
+			particles.Wake(a);
+			particles.Wake(b);
+		}
+		Separate(a, b, dir, off);
+	}
+}
+
+void VerletSolver::UpdateSleepState(size_t index, Vector2 pos, float sqrStep, float dt)
+{
+	const float wakeDst = sleepVelocity * wakeVelocityFactor * dt;
+	if(sqrStep >= wakeDst * wakeDst)
+	{
+		particles.SetFlag(index, ParticleFlags::Moving);
+	}
+	else
+	{
+		particles.ClearFlag(index, ParticleFlags::Moving);
+	}
+
+	//The average instead of the per substep velocity decides, particles in piles jitter a lot while barely moving
+	const float maxDrift = sleepVelocity * sleepTime;
+	const Vector2 drift = pos - Vector2(particles.restX[index], particles.restY[index]);
+	if(particles.restTime[index] == 0.0f || drift.SqrLength() > maxDrift * maxDrift)
+	{
+		particles.restX[index] = pos.x;
+		particles.restY[index] = pos.y;
+		particles.restTime[index] = 0.0f;
+	}
+
+	particles.restTime[index] += dt;
+	if(particles.restTime[index] >= sleepTime)
+	{
+		particles.SetFlag(index, ParticleFlags::Sleeping);
+		particles.SetPrevPosition(index, pos);
+	}
+}
+
+bool VerletSolver::UpdatePressure(size_t index, float dt)
+{
+	if(!particles.HasFlag(index, ParticleFlags::Pressed))
+	{
+		particles.pressTime[index] = std::max(particles.pressTime[index] - dt, 0.0f);
+		return false;
+	}
+
+	particles.ClearFlag(index, ParticleFlags::Pressed);
+	particles.pressTime[index] += dt;
+	return particles.pressTime[index] >= sleepTime * wakePressFactor;
+}
+
+void VerletSolver::CollectStats()
+{
+	const double collisionTime = broadPhaseCounter.EndFrame() + narrowPhaseCounter.EndFrame();
+	updatePhaseCounter.EndFrame();
+	linkPhaseCounter.EndFrame();
+
+	const uint64_t frameTests = pairTests.exchange(0);
+	if(collisionSteps > 0 && particles.Size() > 0)
+	{
+		pairTestsPerParticle = static_cast<double>(frameTests) / (static_cast<double>(collisionSteps) * static_cast<double>(particles.Size()));
+	}
+	if(collisionSteps > 0)
+	{
+		collisionIterations = static_cast<double>(collisionPasses) / static_cast<double>(collisionSteps);
+	}
+	collisionPasses = 0;
+	if(particleSteps > 0)
+	{
+		integratedFraction = static_cast<double>(integratedSteps.exchange(0)) / static_cast<double>(particleSteps);
+		particleSteps = 0;
+	}
+	neighborListRebuilds = std::exchange(neighborListBuilds, 0);
+	sweptParticles = std::exchange(sweptParticleCount, 0);
+	blockedSubsteps = std::exchange(blockedSubstepCount, 0);
+	blockRollbacks = std::exchange(blockRollbackCount, 0);
+	substepHistory[substepHistoryOffset] = static_cast<float>(lastSubsteps);
+	substepHistoryOffset = (substepHistoryOffset + 1) % substepHistory.size();
+	//The grid cell size has no effect on the narrow phase while neighbor lists are used
+	if(autoPartitioning && !neighborLists)
+	{
+		if(std::optional<float> cellSize = partitioningTuner.Update(collisionTime, collisionSteps, particles.Size(), frameTests))
+		{
+			RebuildPartitioning(cellSize.value());
+		}
+	}
+	collisionSteps = 0;
+}
+
+uint64_t VerletSolver::StateChecksum() const
+{
+	uint64_t hash = Math::Fnv1a(particles.posX.data(), particles.Size() * sizeof(float));
+	hash = Math::Fnv1a(particles.posY.data(), particles.Size() * sizeof(float), hash);
+	hash = Math::Fnv1a(particles.prevX.data(), particles.Size() * sizeof(float), hash);
+	hash = Math::Fnv1a(particles.prevY.data(), particles.Size() * sizeof(float), hash);
+	return Math::Fnv1a(particles.flags.data(), particles.Size(), hash);
+}
+
+void VerletSolver::RebuildPartitioning(float cellSize)
+{
+	//A fixed grid keeps the configured amount of levels
+	const uint32_t levels = autoPartitioning ? partitioningTuner.LevelCount(cellSize) : partitioning.LevelCount();
+	partitioning = HierarchicalGrid(constraint.Bounds().first, constraint.Bounds().second, cellSize, levels);
+	assignedStorageVersion = std::numeric_limits<uint32_t>::max();
+	cellStates.clear();
+	cellMoving.clear();
+}
+
+const FrameCounter& VerletSolver::BroadPhaseCounter() const
+{
+	return broadPhaseCounter;
+}
+
+const FrameCounter& VerletSolver::NarrowPhaseCounter() const
+{
+	return narrowPhaseCounter;
+}
+
+const FrameCounter& VerletSolver::UpdatePhaseCounter() const
+{
+	return updatePhaseCounter;
+}
+
+const FrameCounter& VerletSolver::LinkPhaseCounter() const
 {
 	return linkPhaseCounter;
 }
+
+const PartitioningTuner& VerletSolver::Tuner() const
+{
+	return partitioningTuner;
+}
+
+bool VerletSolver::AutoPartitioning() const
+{
+	return autoPartitioning;
+}
+
+float VerletSolver::PartitioningSize() const
+{
+	return partitioning.CellSize();
+}
+
+uint32_t VerletSolver::PartitioningLevels() const
+{
+	return partitioning.LevelCount();
+}
+
+double VerletSolver::PairTestsPerParticle() const
+{
+	return pairTestsPerParticle;
+}
+
+double VerletSolver::CollisionIterations() const
+{
+	return collisionIterations;
+}
+
+float VerletSolver::MaxPenetration() const
+{
+	return lastMaxPenetration;
+}
+
+float VerletSolver::MeanPenetration() const
+{
+	return lastMeanPenetration;
+}
+
+uint32_t VerletSolver::NeighborListRebuilds() const
+{
+	return neighborListRebuilds;
+}
+
+double VerletSolver::IntegratedFraction() const
+{
+	return integratedFraction;
+}
+
+uint32_t VerletSolver::BlockedSubsteps() const
+{
+	return blockedSubsteps;
+}
+
+uint32_t VerletSolver::BlockRollbacks() const
+{
+	return blockRollbacks;
+}
+
+uint32_t VerletSolver::SweptParticles() const
+{
+	return sweptParticles;
+}
+
+const std::array<float, VerletSolver::substepHistoryLength>& VerletSolver::SubstepHistory() const
+{
+	return substepHistory;
+}
+
+size_t VerletSolver::SubstepHistoryOffset() const
+{
+	return substepHistoryOffset;
+}
+
+bool VerletSolver::Deterministic() const
+{
+	return deterministic;
+}
+
+uint64_t VerletSolver::StepCount() const
+{
+	return stepCount;
+}
+
+uint64_t VerletSolver::Checksum() const
+{
+	return checksum;
+}
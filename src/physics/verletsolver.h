@@ -1,19 +1,56 @@
 #pragma once
 #include "solversettings.h"
 #include "constraint.h"
-#include "partitioning.h"
+#include "hierarchicalgrid.h"
+#include "partitioningtuner.h"
+#include "bakedforcefield.h"
+#include "forcefieldkernels.h"
+#include "forcefieldgrid.h"
+#include "staticcolliders.h"
+#include "particlestorage.h"
+#include "narrowphase.h"
+#include "utils/cpu.h"
 #include "ecs/world.h"
 #include "utils/framecounter.h"
 #include "structs/vector2.h"
 #include <cstdint>
+#include <limits>
+#include <atomic>
+#include <vector>
+#include <map>
+#include <optional>
+#include <array>
+#include <span>
 
 class VerletSolver
 {
 public:
 	Vector2 gravity;
 	uint32_t substeps;
+	bool adaptiveSubsteps;
+	uint32_t minSubsteps;
+	uint32_t maxSubsteps;
+	bool multiRateSubsteps;
+	uint32_t maxSubstepStride;
 	bool collision;
+	SolverCollisionMode collisionMode;
+	float relaxation;
+	bool adaptiveIterations;
+	uint32_t maxIterations;
+	float overlapTolerance;
+	bool neighborLists;
+	float neighborSkin;
+	bool temporalBlocking;
+	uint32_t blockSubsteps;
+	bool continuousCollision;
+	float ccdThreshold;
+	bool sleeping;
+	float sleepVelocity;
+	float sleepTime;
 	SolverUpdateMode updateMode;
+	SimdLevel simdLevel;
+
+	static constexpr size_t substepHistoryLength = 120;
 
 	VerletSolver(EcsWorld& ecs, IConstraint& constraint, const SolverSettings& settings);
 	void Update(float dt);
@@ -21,26 +58,311 @@ public:
 	const FrameCounter& NarrowPhaseCounter() const;
 	const FrameCounter& UpdatePhaseCounter() const;
 	const FrameCounter& LinkPhaseCounter() const;
+	const PartitioningTuner& Tuner() const;
+	bool AutoPartitioning() const;
+	float PartitioningSize() const;
+	uint32_t PartitioningLevels() const;
+	//Candidate pairs tested per particle and substep in the last frame
+	double PairTestsPerParticle() const;
+	//Collision passes per substep in the last frame
+	double CollisionIterations() const;
+	//Deepest and mean overlap found by the last collision pass, relative to the radii of the pairs
+	float MaxPenetration() const;
+	float MeanPenetration() const;
+	//Share of the particle substeps of the last frame which integrated their particle
+	double IntegratedFraction() const;
+	//Neighbor lists built in the last frame
+	uint32_t NeighborListRebuilds() const;
+	//Substeps run as part of a block in the last frame
+	uint32_t BlockedSubsteps() const;
+	//Blocks undone in the last frame because a particle left the skin of the lists before the block was done
+	uint32_t BlockRollbacks() const;
+	//Fast particles swept in the last frame, summed over its substeps
+	uint32_t SweptParticles() const;
+	//Substeps of the last step of each of the previous rendered frames, oldest first starting at SubstepHistoryOffset
+	const std::array<float, substepHistoryLength>& SubstepHistory() const;
+	size_t SubstepHistoryOffset() const;
+	bool Deterministic() const;
+	uint64_t StepCount() const;
+	//Hash of the particle state after the last step, only taken in deterministic mode
+	uint64_t Checksum() const;
 
 private:
+	enum CellState : uint8_t
+	{
+		CellAwake = 1 << 0,
+		CellSleeping = 1 << 1
+	};
+
+	static constexpr int32_t minStripeWidth = 2;
+	//Particles only wake their neighborhood above this multiple of the sleep velocity, so jittering piles don't keep each other awake
+	static constexpr float wakeVelocityFactor = 4.0f;
+	//Sleeping particles pushed into by awake ones for this multiple of the sleep time wake up,
+	//particles merely resting on a sleeping pile fall asleep themselves before that and stop adding to it,
+	//a pusher stuck at the pile only dozes off for single substeps and keeps adding
+	static constexpr float wakePressFactor = 2.0f;
+	static constexpr size_t parallelSleepThreshold = 8192;
+	//Particles updated at a time, force fields and the world constraint are applied to the whole block
+	static constexpr size_t updateBlockSize = 16;
+	//In adaptive mode the fastest particle moves at most this fraction of the smallest radius per substep,
+	//two of the smallest particles heading at each other then can't pass through each other in one substep
+	static constexpr float maxSubstepTravel = 1.0f;
+	//Color classes with less links are solved on the calling thread
+	static constexpr size_t parallelLinkThreshold = 1024;
+	//Particles a tile of blocked substeps aims for, so the tile with its pairs stays in a typical L2 cache
+	static constexpr size_t tileParticleTarget = 4096;
+	//Tiles a scene needs to span before blocks pay for their snapshots and checks, below that it stays in cache anyway
+	static constexpr size_t blockMinTiles = 4;
+	//Blocks are kept short enough for the fastest particle to stay inside of the skin while covering this multiple of its last substep
+	//in every substep of the block, which keeps undone blocks rare, the lists are still checked after every substep of a block
+	static constexpr float blockTravelFactor = 2.0f;
+
+	//Stripe boundary for the three parts of a substep, the pairs of even stripes, the pairs of odd stripes and the integration
+	using StripeCut = std::array<int32_t, 3>;
+
+	//State of a particle at the start of a block, which a block is undone to
+	struct BlockState
+	{
+		Vector2 pos;
+		Vector2 prev;
+		Vector2 acc;
+	};
+
+	//Particles of an ecs archetype which lie back to back in storage, starting at storage index begin
+	struct StorageRun
+	{
+		uint32_t begin;
+		uint32_t count;
+	};
+
+	//Particles already copied from an ecs archetype, runs follow the order of the archetype
+	struct SyncedArchetype
+	{
+		size_t count = 0;
+		std::vector<StorageRun> runs = {};
+	};
+
+	//Link with both particles resolved to storage indices
+	struct SolverLink
+	{
+		uint32_t a;
+		uint32_t b;
+		float distance;
+		bool restrictMin;
+		bool restrictMax;
+	};
+
 	float timeStep;
-	float partitioningSize;
+	float stepTimer = 0.0f;
+	//Substeps and substep length of the last step, to predict how far particles move in the next one
+	uint32_t lastSubsteps = 0;
+	float lastStepDt = 0.0f;
+	//Largest squared distance a particle moved in the last substep
+	std::atomic<float> maxSqrStep = 0.0f;
+	//Substep running in the current step
+	uint32_t substep = 0;
+	//Whether the last step ran at multiple rates and the largest stride a cell can take in it as a power of two,
+	//strides divide the substep count so all cells meet again at the end of the step
+	bool multiRateActive = false;
+	uint8_t maxRateShift = 0;
+	//Per cell of the coarsest level, the longest squared distance its particles move per substep and its stride as a power of two
+	std::vector<float> tileTravel = {};
+	std::vector<uint8_t> tileRates = {};
+	std::vector<uint8_t> nextTileRates = {};
+	//Particles which aren't pinned sorted by rate key, twice their rate shift plus one unless their cell borders a faster one,
+	//key k owns [rateKeyStarts[k], rateKeyStarts[k + 1]), so the particles of a substep and those around them are a prefix
+	std::vector<uint8_t> rateKeys = {};
+	std::vector<uint32_t> rateParticles = {};
+	std::vector<uint32_t> rateKeyStarts = {};
+	//Per job and key in the sort by rate key
+	std::vector<std::vector<uint32_t>> jobRateCounts = {};
+	//Largest rate shift taking the running substep
+	uint8_t activeRateShift = 0;
+	//Particle substeps integrated and possible since the last rendered frame
+	std::atomic<uint64_t> integratedSteps = 0;
+	uint64_t particleSteps = 0;
+	double integratedFraction = 1.0;
+	std::array<float, substepHistoryLength> substepHistory = {};
+	size_t substepHistoryOffset = 0;
+	bool deterministic;
+	bool autoPartitioning;
+	bool bakeForceFields;
+	float forceFieldResolution;
 	EcsWorld& ecs;
 	IConstraint& constraint;
-	PartitioningGrid partitioning;
+	HierarchicalGrid partitioning;
+	PartitioningTuner partitioningTuner;
+	//Collision passes and candidate pairs tested since the last rendered frame
+	uint32_t collisionSteps = 0;
+	uint32_t collisionPasses = 0;
+	double collisionIterations = 0.0;
+	//Overlaps found by the running collision pass
+	std::atomic<float> passMaxPenetration = 0.0f;
+	std::atomic<double> passPenetrationSum = 0.0;
+	std::atomic<uint64_t> passContacts = 0;
+	float lastMaxPenetration = 0.0f;
+	float lastMeanPenetration = 0.0f;
+	//Collision pass of the running substep, passes after the first only revisit cells around overlaps the one before left
+	uint32_t collisionPass = 0;
+	//Per cell of the coarsest level, whether a pair solved from it was still above the tolerance in the last and in the running pass
+	std::vector<uint8_t> unresolvedCells = {};
+	std::vector<uint8_t> nextUnresolvedCells = {};
+	std::atomic<uint64_t> pairTests = 0;
+	double pairTestsPerParticle = 0.0;
+	uint64_t stepCount = 0;
+	uint64_t checksum = 0;
+	ParticleStorage particles = {};
+	//A reorder leaves a single run per archetype, particles synced after it are appended to the storage as further runs
+	std::map<ArchetypeId, SyncedArchetype> syncedArchetypes = {};
+	//Storage version the grid levels were assigned for
+	uint32_t assignedStorageVersion = std::numeric_limits<uint32_t>::max();
+	uint32_t reorderInterval;
+	uint32_t framesSinceReorder = 0;
+	//Per grid cell of all levels, which CellState flags its particles have and whether a particle in it or its children moved
+	std::vector<uint8_t> cellStates = {};
+	std::vector<uint8_t> cellMoving = {};
+	//Cells of all levels each job of the last flag pass wrote to
+	std::vector<std::vector<uint32_t>> jobFlaggedCells = {};
+	//Corrections accumulated per particle in Jacobi mode
+	std::vector<float> deltaX = {};
+	std::vector<float> deltaY = {};
+	std::vector<uint32_t> contacts = {};
+	//Corrections of the previous positions, which move velocity between the particles of different rates
+	std::vector<float> prevDeltaX = {};
+	std::vector<float> prevDeltaY = {};
+	//Links grouped into classes without shared particles, class c owns [linkColorOffsets[c], linkColorOffsets[c + 1])
+	//Inside of a class links keep the order of a breadth first walk along the linked particles
+	std::vector<SolverLink> links = {};
+	std::vector<size_t> linkColorOffsets = {};
+	//Particles of each link in ecs query order
+	std::vector<std::pair<uint32_t, uint32_t>> linkParticles = {};
+	//Force fields which aren't baked, sorted by kernel and listed per cell of the coarsest grid level
+	ForceFieldGrid forceFields = {};
+	//Amount of fields in the ecs when the lists were built, fields are only ever added
+	size_t builtFieldCount = 0;
+	std::optional<BakedForceField> bakedForceField = std::nullopt;
+	//Amount of fields in the ecs when they were baked, fields are only ever added
+	size_t bakedFieldCount = 0;
+	StaticColliders colliders = {};
+	//Amount of colliders in the ecs when the hierarchy was built, colliders are only ever added
+	size_t builtColliderCount = 0;
+	//Pairs closer than their radii plus the skin, grouped by the stripe of the coarsest level of the neighbor grid their left particle was binned in
+	//Stripes of one pass don't share any particles, as with the grid, and the pairs keep the stripe they were built in
+	std::optional<HierarchicalGrid> neighborGrid = std::nullopt;
+	//Radii grown by half the skin, which the levels of the neighbor grid are assigned by
+	std::vector<float> neighborRadii = {};
+	std::vector<std::vector<std::pair<uint32_t, uint32_t>>> neighborPairs = {};
+	//Particles of each stripe which aren't pinned, integrated stripe by stripe in blocked substeps
+	std::vector<std::vector<uint32_t>> neighborStripeParticles = {};
+	//Positions when the lists were built and the furthest any particle got from its position since, tracked while integrating
+	std::vector<float> neighborX = {};
+	std::vector<float> neighborY = {};
+	std::atomic<float> maxSqrListTravel = 0.0f;
+	uint32_t neighborStorageVersion = std::numeric_limits<uint32_t>::max();
+	uint32_t neighborListBuilds = 0;
+	uint32_t neighborListRebuilds = 0;
+	int32_t neighborStripeWidth = 0;
+	uint32_t blockedSubstepCount = 0;
+	uint32_t blockedSubsteps = 0;
+	uint32_t blockRollbackCount = 0;
+	uint32_t blockRollbacks = 0;
+	//Set by the tile which finds a particle outside of the skin, the block is then undone from the state it started with
+	std::atomic<bool> blockStale = false;
+	//States of the particles of each stripe which isn't pinned, stripe s owns [blockStripeOffsets[s], blockStripeOffsets[s + 1]),
+	//a tile saves the stripes it reaches first while they are in cache anyway, so only the stripes a job got to are saved
+	std::vector<BlockState> blockStates = {};
+	std::vector<uint32_t> blockStripeOffsets = {};
+	std::vector<int32_t> jobSavedStripes = {};
+	//Particles faster than the sweep threshold in the running substep, found per job and joined in job order
+	std::vector<std::vector<uint32_t>> jobFastParticles = {};
+	std::vector<uint32_t> fastParticles = {};
+	//Position and previous position of each fast particle after its sweep
+	std::vector<Vector2> sweptPositions = {};
+	std::vector<Vector2> sweptPrevPositions = {};
+	uint32_t sweptParticleCount = 0;
+	uint32_t sweptParticles = 0;
+	//Storage version the link table was built for
+	uint32_t linkStorageVersion = std::numeric_limits<uint32_t>::max();
+	//Particles which aren't pinned, the only ones integrated
+	std::vector<uint32_t> movingParticles = {};
+	uint32_t movingStorageVersion = std::numeric_limits<uint32_t>::max();
 	FrameCounter broadPhaseCounter = FrameCounter(0.25f);
 	FrameCounter narrowPhaseCounter = FrameCounter(0.25f);
 	FrameCounter updatePhaseCounter = FrameCounter(0.25f);
 	FrameCounter linkPhaseCounter = FrameCounter(0.25f);
 	ThreadPool threadPool = {};
 
+	void SyncParticles();
+	void WriteTransforms();
+	void ReorderParticles();
 	void Simulate(float dt);
+	uint32_t AdaptiveSubsteps(float dt) const;
+	void RescaleVelocities(float scale);
+	void AssignRates();
+	void ResetRates();
+	void SortByRate();
+	//Flags the particles of the rates which stop taking substeps as waiting and wakes the ones which start again
+	void UpdateWaiting();
+	//Particles to integrate in the running substep, all which aren't pinned unless rates are active
+	std::span<const uint32_t> ActiveParticles() const;
 	void Collisions();
-	void SolveCell(PartitioningCell& cell);
-	void SolveCells(PartitioningCell& cell0, PartitioningCell& cell1);
-	void Solve(Transform& aTransform, Particle& a, Transform& bTransform, Particle& b);
+	void CollisionPass();
+	void GaussSeidelCollisions();
+	void MergePenetration(float maxPenetration, double penetrationSum, uint64_t overlapping);
+	void JacobiCollisions();
+	void UpdateCellStates();
+	void FlagCells(uint32_t beginColumn, uint32_t endColumn, std::vector<uint32_t>& flagged);
+	void WakeCells(uint32_t beginColumn, uint32_t endColumn);
+	bool IsCellAwake(uint32_t cell) const;
+	bool IsCellUnresolved(uint32_t level, int32_t x, int32_t y) const;
+	void MarkUnresolved(uint32_t level, int32_t x, int32_t y);
+	void SolveColumns(uint32_t level, int32_t begin, int32_t end, NarrowPhase::PackedCell& packed);
+	void SolveLevels(uint32_t level, uint32_t coarse, int32_t begin, int32_t end, NarrowPhase::PackedCell& packed);
+	void AccumulateColumns(uint32_t level, int32_t begin, int32_t end, NarrowPhase::PackedCell& packed);
+	//Whether any particle moved further than half the skin since the lists were built
+	bool NeighborListsStale() const;
+	//Squared distance of pos to the position of the particle when the lists were built
+	float ListTravel(uint32_t index, Vector2 pos) const;
+	void MergeListTravel(float sqrTravel);
+	void BuildNeighborLists();
+	void SolveNeighborLists();
+	uint32_t BlockLength(uint32_t remaining) const;
+	//Returns false if the block was undone, its substeps then have to run one at a time
+	bool SimulateBlock(float dt, uint32_t steps);
+	void SaveStripes(int32_t begin, int32_t end);
+	void RestoreStripes(int32_t begin, int32_t end);
+	//Checks the integrated particles against the lists if checkLists is set
+	void AdvanceStripes(const StripeCut& from, const StripeCut& to, float dt, ConstraintKernel constrain, bool checkLists);
+	void ContinuousCollisions();
+	//Finds the first particle the particle at index runs into on its way from from to to, see StaticColliders::Sweep
+	bool SweepParticles(uint32_t index, Vector2 from, Vector2 to, float& t, Vector2& normal) const;
+	void SolveCell(NarrowPhase::PackedCell& cell);
+	void SolveCells(PartitioningCell cell0, NarrowPhase::PackedCell& cell1);
+	//Both return the overlap of the pair relative to its radii, 0 without any
+	float Solve(uint32_t a, uint32_t b);
+	//Moves a by amount along dir and b the other way, split by their masses
+	void Separate(uint32_t a, uint32_t b, Vector2 dir, float amount);
+	float Accumulate(uint32_t a, uint32_t b);
+	//Marks a sleeping particle as pressed if the other one overlapping it is awake
+	void Press(uint32_t index, uint32_t other);
 	void UpdateObjects(float dt);
+	//Integrates the particles [offset, offset + amount) or, if given, the amount particles listed in indices, none of them may be pinned
+	//Returns the furthest squared distance of the particles to their positions when the neighbor lists were built
+	float IntegrateParticles(size_t offset, const uint32_t* indices, size_t amount, float dt, ConstraintKernel constrain);
 	void UpdateLinks(float dt);
-	Vector2 CalcForceField(const ForceField& forceField, Particle& particle, Vector2 pos);
+	//Solves the links [begin, end), returns the same distance as IntegrateParticles for the particles of the links
+	float SolveLinks(size_t begin, size_t end, float dt);
+	void BuildLinks();
+	//Moves the link table along with a reorder of the particle storage, order lists the old index of every new one
+	void RemapLinks(const std::vector<uint32_t>& order);
+	void BuildForceFields();
+	void BakeForceFields();
+	void BuildColliders();
+	void SolveLink(const SolverLink& link, float dt);
+	void UpdateSleepState(size_t index, Vector2 pos, float sqrStep, float dt);
+	//Whether a sleeping particle has been pressed long enough to wake up
+	bool UpdatePressure(size_t index, float dt);
 	void CollectStats();
+	uint64_t StateChecksum() const;
+	void RebuildPartitioning(float cellSize);
 };
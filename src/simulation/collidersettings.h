@@ -0,0 +1,51 @@
+#pragma once
+#include "structs/vector2.h"
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <utility>
+
+enum class ColliderShape
+{
+	Segment,
+	Polygon
+};
+
+struct ColliderSettings
+{
+	ColliderShape shape = ColliderShape::Segment;
+	float length = 200.0f;
+	uint32_t sides = 4;
+	float polygonRadius = 100.0f;
+	float rotation = 0.0f;
+	float thickness = 4.0f;
+
+	//Corners relative to the position, a polygon closes with its first corner
+	std::vector<Vector2> Points() const
+	{
+		std::vector<Vector2> points = {};
+		if(shape == ColliderShape::Segment)
+		{
+			const Vector2 half = Vector2::Rotate(Vector2(length * 0.5f, 0.0f), rotation);
+			points.push_back(Vector2::zero - half);
+			points.push_back(half);
+			return points;
+		}
+		for(uint32_t i = 0; i <= sides; i++)
+		{
+			points.push_back(Vector2::Rotate(Vector2(polygonRadius, 0.0f), rotation + 360.0f * static_cast<float>(i % sides) / static_cast<float>(sides)));
+		}
+		return points;
+	}
+
+	std::vector<std::pair<Vector2, Vector2>> Segments(Vector2 pos) const
+	{
+		const std::vector<Vector2> points = Points();
+		std::vector<std::pair<Vector2, Vector2>> segments = {};
+		for(size_t i = 0; i + 1 < points.size(); i++)
+		{
+			segments.emplace_back(pos + points[i], pos + points[i + 1]);
+		}
+		return segments;
+	}
+};
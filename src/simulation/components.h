@@ -4,3 +4,4 @@
 #include "components/particle.h"
 #include "components/link.h"
 #include "components/forcefield.h"
+#include "components/collider.h"
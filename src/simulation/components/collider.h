@@ -0,0 +1,13 @@
+#pragma once
+#include "ecs/component.h"
+#include "structs/vector2.h"
+
+//Static segment, particles collide with the capsule around it
+struct Collider : Component<Collider>
+{
+	Vector2 from;
+	Vector2 to;
+	float radius;
+
+	Collider(Vector2 from, Vector2 to, float radius) : from(from), to(to), radius(radius) { }
+};
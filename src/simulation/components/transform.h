@@ -12,4 +12,9 @@ struct Transform : Component<Transform>
 	{
 		return *reinterpret_cast<Vector2*>(&value.cells[12]);
 	}
+
+	const Vector2& Position() const
+	{
+		return *reinterpret_cast<const Vector2*>(&value.cells[12]);
+	}
 };
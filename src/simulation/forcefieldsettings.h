@@ -2,6 +2,7 @@
 #include "structs/vector2.h"
 #include "structs/color.h"
 #include "structs/gradient.h"
+#include <cmath>
 
 enum class ForceFieldShape
 {
@@ -62,6 +63,18 @@ struct ForceFieldSettings
 		}
 	};
 
+	//Half size of the axis aligned box around the field
+	Vector2 Extents() const
+	{
+		if(shape == ForceFieldShape::Circle)
+		{
+			return Vector2(range, range);
+		}
+		const float s = std::fabs(sinf(rectRotation * 0.0174533f));
+		const float c = std::fabs(cosf(rectRotation * 0.0174533f));
+		return Vector2(c * rectSize.x + s * rectSize.y, s * rectSize.x + c * rectSize.y) * 0.5f;
+	}
+
 	float ApplyFalloff(float x) const
 	{
 		switch(falloff)
@@ -1,13 +1,36 @@
 #include "simulation.h"
 #include "renderer/graphics.h"
+#include <algorithm>
+#include <cmath>
 
-Simulation::Simulation(std::unique_ptr<World> world, const SolverSettings& solverSettings) : world(std::move(world))
+Simulation::Simulation(std::unique_ptr<World> world, const SolverSettings& solverSettings) : world(std::move(world)), seed(solverSettings.seed)
 {
+	if(solverSettings.deterministic)
+	{
+		fixedStep = solverSettings.timestep;
+	}
 	ecs = std::make_unique<EcsWorld>();
 	solver = std::make_unique<VerletSolver>(*ecs.get(), static_cast<IConstraint&>(*this->world.get()), solverSettings);
 }
 
 void Simulation::Update(double dt)
+{
+	if(!fixedStep)
+	{
+		Step(dt);
+		return;
+	}
+
+	//Frame times only decide how many steps run, the steps themselves always see the same delta time
+	stepTimer += std::min(dt, 0.25);
+	while(stepTimer >= fixedStep.value())
+	{
+		Step(fixedStep.value());
+		stepTimer -= fixedStep.value();
+	}
+}
+
+void Simulation::Step(double dt)
 {
 	for(Spawner& spawner : spawners)
 	{
@@ -20,6 +43,11 @@ void Simulation::Update(double dt)
 void Simulation::Render()
 {
 	world->Render();
+	for(size_t i = 0; i < colliderCirclePositions.size(); i += Graphics::instancingLimit)
+	{
+		const int count = static_cast<int>(std::min(colliderCirclePositions.size() - i, static_cast<size_t>(Graphics::instancingLimit)));
+		Graphics::CirclesInstanced(&colliderCirclePositions[i], &colliderCircleRadii[i], &colliderCircleColors[i], count);
+	}
 	ecs->QueryChunked<Transform, RenderColor, Link>(Graphics::instancingLimit, [](Transform* transform, RenderColor* renderColor, Link* _, size_t chunkSize)
 	{
 		Graphics::LinesInstanced(reinterpret_cast<const Matrix4*>(transform), reinterpret_cast<const Color*>(renderColor), chunkSize);
@@ -43,6 +71,10 @@ void Simulation::AddParticle(Particle&& particle, Vector2 pos, const Color& colo
 
 void Simulation::AddSpawner(Spawner&& spawner, uint32_t objId)
 {
+	if(fixedStep)
+	{
+		spawner.Seed(seed, static_cast<uint32_t>(spawners.size()));
+	}
 	spawners.push_back(std::move(spawner));
 }
 
@@ -62,3 +94,18 @@ void Simulation::AddForceField(ForceField&& forceField, uint32_t objId)
 {
 	ecs->CreateEntity(std::move(forceField));
 }
+
+void Simulation::AddCollider(Collider&& collider, const Color& color)
+{
+	//Overlapping circles along the segment draw the capsule
+	const float radius = std::max(collider.radius, 1.0f);
+	const float length = Vector2::Distance(collider.from, collider.to);
+	const uint32_t steps = std::max(static_cast<uint32_t>(std::ceilf(length / (radius * 0.5f))), 1u);
+	for(uint32_t i = 0; i <= steps; i++)
+	{
+		colliderCirclePositions.push_back(collider.from + (collider.to - collider.from) * (static_cast<float>(i) / static_cast<float>(steps)));
+		colliderCircleRadii.push_back(radius);
+		colliderCircleColors.push_back(color);
+	}
+	ecs->CreateEntity(std::move(collider));
+}
@@ -8,6 +8,7 @@
 #include <vector>
 #include <unordered_map>
 #include <cstdint>
+#include <optional>
 
 class Simulation
 {
@@ -21,6 +22,7 @@ public:
 	void AddSpawner(Spawner&& spawner, uint32_t objId = 0);
 	void AddLink(Link&& link, uint32_t p0Id, uint32_t p1Id, const Color& color, uint32_t objId = 0);
 	void AddForceField(ForceField&& forceField, uint32_t objId);
+	void AddCollider(Collider&& collider, const Color& color);
 
 	uint32_t ParticleAmount() const { return particleAmount; }
 	const VerletSolver& Solver() const { return *solver; }
@@ -32,5 +34,15 @@ private:
 
 	std::unordered_map<uint32_t, Entity> placedEntityMap = {};
 	std::vector<Spawner> spawners = {};
+	//Colliders never move, so the circles filling them out are placed once
+	std::vector<Vector2> colliderCirclePositions = {};
+	std::vector<float> colliderCircleRadii = {};
+	std::vector<Color> colliderCircleColors = {};
 	uint32_t particleAmount = 0;
+	//Set in deterministic mode, spawners and solver advance together in steps of this size
+	std::optional<float> fixedStep = std::nullopt;
+	double stepTimer = 0.0;
+	uint32_t seed = 0;
+
+	void Step(double dt);
 };
@@ -10,6 +10,7 @@ public:
 	Spawner(Vector2 position, const SpawnerSettings& settings) : position(position), settings(settings), time(settings.spawnRate) { }
 
 	void Update(class Simulation& simulation, float dt);
+	void Seed(uint32_t seed, uint32_t stream) { random = Random(seed, stream); }
 
 private:
 	Vector2 position;
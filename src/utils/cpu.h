@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CPU_X64 1
+#else
+#define CPU_X64 0
+#endif
+
+//Functions using intrinsics above the compiled baseline have to be marked for gcc/clang, msvc allows them anywhere
+#if defined(__GNUC__) || defined(__clang__)
+#define CPU_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CPU_TARGET_AVX2
+#endif
+
+enum class SimdLevel
+{
+	Scalar,
+	SSE,
+	AVX2
+};
+
+namespace Cpu
+{
+	inline void CpuId(int32_t info[4], int32_t leaf, int32_t subLeaf)
+	{
+#if defined(_MSC_VER)
+		__cpuidex(info, leaf, subLeaf);
+#else
+		__cpuid_count(leaf, subLeaf, info[0], info[1], info[2], info[3]);
+#endif
+	}
+
+	inline uint64_t XGetBv()
+	{
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		uint32_t eax = 0;
+		uint32_t edx = 0;
+		__asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+	}
+
+	//Highest level every cpu of the target architecture has, so results don't depend on the machine
+	inline SimdLevel BaselineSimdLevel()
+	{
+#if CPU_X64
+		return SimdLevel::SSE;
+#else
+		return SimdLevel::Scalar;
+#endif
+	}
+
+	inline SimdLevel DetectSimdLevel()
+	{
+		static const SimdLevel level = []
+		{
+#if CPU_X64
+			int32_t info[4] = {};
+			CpuId(info, 0, 0);
+			const int32_t maxLeaf = info[0];
+
+			CpuId(info, 1, 0);
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool avx = (info[2] & (1 << 28)) != 0;
+			//The OS has to save the ymm registers on context switches
+			const bool osAvx = osxsave && (XGetBv() & 0x6) == 0x6;
+			if(maxLeaf >= 7 && avx && osAvx)
+			{
+				CpuId(info, 7, 0);
+				if((info[1] & (1 << 5)) != 0)
+				{
+					return SimdLevel::AVX2;
+				}
+			}
+			//SSE2 is part of the x64 baseline
+			return SimdLevel::SSE;
+#else
+			return SimdLevel::Scalar;
+#endif
+		}();
+		return level;
+	}
+}
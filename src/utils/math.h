@@ -1,5 +1,7 @@
 #pragma once
 #include <cmath>
+#include <cstdint>
+#include <cstddef>
 #include <algorithm>
 
 namespace Math
@@ -30,6 +32,32 @@ namespace Math
 		return from + (to - from) * std::clamp(t, 0.0f, 1.0f);
 	}
 
+	//Interleaves the lower 16 bits of x and y into a z-order curve key
+	inline uint32_t Morton2D(uint32_t x, uint32_t y)
+	{
+		const auto spread = [](uint32_t v)
+		{
+			v &= 0x0000FFFF;
+			v = (v | (v << 8)) & 0x00FF00FF;
+			v = (v | (v << 4)) & 0x0F0F0F0F;
+			v = (v | (v << 2)) & 0x33333333;
+			v = (v | (v << 1)) & 0x55555555;
+			return v;
+		};
+		return spread(x) | (spread(y) << 1);
+	}
+
+	//FNV-1a over raw bytes, pass a previous result as hash to continue it
+	inline uint64_t Fnv1a(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for(size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
+
 	inline float InverseLerp(float from, float to, float value)
 	{
 		if(from == to)
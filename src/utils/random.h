@@ -7,6 +7,13 @@ class Random
 public:
 	Random() : generator(std::random_device()()) { }
 
+	//Reproducible sequence, different streams of the same seed are independent of each other
+	Random(uint32_t seed, uint32_t stream)
+	{
+		std::seed_seq seq = { seed, stream };
+		generator.seed(seq);
+	}
+
 	float Value()
 	{
 		static std::uniform_real_distribution<float> dist { 0.0f, 1.0f };
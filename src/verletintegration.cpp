@@ -1,6 +1,8 @@
 #include <iostream>
 #include <memory>
 #include <optional>
+#include <array>
+#include <string>
 
 #include "engine/window.h"
 #include "utils/framecounter.h"
@@ -8,13 +10,19 @@
 #include "simulation/simulation.h"
 #include "engine/input.h"
 #include "imgui.h"
+#include "benchmark/benchmark.h"
 
 static const float windowSize = 1080;
 
 void DrawStats(const FrameCounter& frameCounter, const Simulation& simulation, float renderTime);
 
-int main()
+int main(int argc, char** argv)
 {
+	if(argc > 1 && std::string(argv[1]) == "--benchmark")
+	{
+		return Benchmark::Run(argc - 2, argv + 2);
+	}
+
 	std::shared_ptr<Window> window = std::make_shared<Window>(static_cast<unsigned int>(windowSize), static_cast<unsigned int>(windowSize), "Verlet Integration", -1, -1, true);
 	FrameCounter frameCounter = FrameCounter(0.5);
 	std::optional<Simulation> simulation = std::nullopt;
@@ -65,6 +73,52 @@ void DrawStats(const FrameCounter& frameCounter, const Simulation& simulation, f
 		ImGui::Text("Narrow:  %.2f ms", simulation.Solver().NarrowPhaseCounter().Frametime() * 1000.0);
 		ImGui::Text("Update:  %.2f ms", simulation.Solver().UpdatePhaseCounter().Frametime() * 1000.0);
 		ImGui::Text("Link:    %.2f ms", simulation.Solver().LinkPhaseCounter().Frametime() * 1000.0);
+		ImGui::Separator();
+		const VerletSolver& solver = simulation.Solver();
+		const PartitioningTuner& tuner = solver.Tuner();
+		ImGui::Text("Cell:    %.1f x%u%s", solver.PartitioningSize(), solver.PartitioningLevels(), tuner.Tuning() ? " (tuning)" : "");
+		ImGui::Text("Pairs:   %.1f / particle", solver.PairTestsPerParticle());
+		if(solver.adaptiveSubsteps)
+		{
+			const std::array<float, VerletSolver::substepHistoryLength>& history = solver.SubstepHistory();
+			const std::string overlay = "Substeps: " + std::to_string(static_cast<uint32_t>(history[(solver.SubstepHistoryOffset() + history.size() - 1) % history.size()]));
+			ImGui::PlotLines("##substepsPlot", history.data(), static_cast<int>(history.size()), static_cast<int>(solver.SubstepHistoryOffset()),
+				overlay.c_str(), 0.0f, static_cast<float>(solver.maxSubsteps), ImVec2(160.0f, 40.0f));
+		}
+		if(solver.multiRateSubsteps)
+		{
+			ImGui::Text("Rates:   %.0f%% integrated", solver.IntegratedFraction() * 100.0);
+		}
+		if(solver.adaptiveIterations)
+		{
+			ImGui::Text("Passes:  %.2f / substep", solver.CollisionIterations());
+			ImGui::Text("Overlap: max %.3f mean %.3f", solver.MaxPenetration(), solver.MeanPenetration());
+		}
+		if(solver.neighborLists)
+		{
+			ImGui::Text("Lists:   %u rebuilds", solver.NeighborListRebuilds());
+			if(solver.temporalBlocking)
+			{
+				ImGui::Text("Blocked: %u substeps, %u undone", solver.BlockedSubsteps(), solver.BlockRollbacks());
+			}
+		}
+		if(solver.continuousCollision)
+		{
+			ImGui::Text("Swept:   %u particles", solver.SweptParticles());
+		}
+		if(solver.AutoPartitioning() && tuner.Cost() > 0.0)
+		{
+			//Effect measured by the last tuning round, collision time per 1000 particles and substep
+			ImGui::Text("Tuned:   %.1f -> %.1f", tuner.PreviousCellSize(), solver.PartitioningSize());
+			ImGui::Text("         %.2f -> %.2f us/1k", tuner.PreviousCost(), tuner.Cost());
+			ImGui::Text("         %.1f -> %.1f pairs", tuner.PreviousPairTests(), tuner.PairTests());
+		}
+		if(solver.Deterministic())
+		{
+			ImGui::Separator();
+			ImGui::Text("Step:    %llu", static_cast<unsigned long long>(solver.StepCount()));
+			ImGui::Text("State:   %016llx", static_cast<unsigned long long>(solver.Checksum()));
+		}
 		ImGui::End();
 	}
 }